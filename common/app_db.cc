@@ -17,15 +17,22 @@
 #include "common/app_db.h"
 
 //  #define USE_APP_PREFERENCE;
+//  USE_APP_LOG_DB is defined by the appdb_log gyp variable.
 #ifdef USE_APP_PREFERENCE
 #include <app_preference.h>
 #else
 #include <app.h>
+#include <fcntl.h>
 #include <sqlite3.h>
+#include <sys/mman.h>
 #include <unistd.h>
 #include <fstream>
 #endif
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
 #include <memory>
 
 #include "common/logger.h"
@@ -36,6 +43,12 @@
 #ifndef USE_APP_PREFERENCE
 #include "common/app_db_sqlite.h"
 #endif
+#ifdef USE_APP_LOG_DB
+#include "common/app_db_log.h"
+#endif
+#ifdef APPDB_CACHE
+#include "common/app_db_cache.h"
+#endif
 
 namespace common {
 
@@ -49,6 +62,116 @@ const char* kCreateDbQuery = "CREATE TABLE IF NOT EXISTS appdb ("
                              "key TEXT, "
                              "value TEXT,"
                              "PRIMARY KEY(section, key));";
+// Indexed by SqliteDB::StatementType.
+const char* kStatementQueries[] = {
+  "select count(*) from appdb where section = ? and key = ?",
+  "select value from appdb where section = ? and key = ?",
+  "replace into appdb (section, key, value) values (?, ?, ?)",
+  "delete from appdb where section = ? and key = ?",
+  "select key from appdb where section = ?",
+  // The keys with a prefix are the first ones from the prefix on.
+  "select key, value from appdb where section = ? and key >= ? order by key"
+};
+
+// The database is only read and written by the runtime and the renderer of
+// the app, so WAL lets the renderer read while the runtime writes. With WAL,
+// synchronous=NORMAL only syncs on checkpoints, and a power loss can drop
+// the last commits but can not corrupt the database.
+const char* kJournalModeQuery = "PRAGMA journal_mode=WAL";
+const char* kSynchronousQuery = "PRAGMA synchronous=NORMAL";
+
+// A read or an Apply() finding the db locked waits for it at most this many
+// times this long, so a short write of another process does not look like a
+// missing key or a failed write.
+const int kBusyWaitRetries = 10;
+const int kBusyWaitUs = 2000;
+
+// Sets a flag for the lifetime of the scope.
+class ScopedFlag {
+ public:
+  explicit ScopedFlag(bool* flag) : flag_(flag) { *flag_ = true; }
+  ~ScopedFlag() { *flag_ = false; }
+ private:
+  bool* flag_;
+};
+
+// Resets a cached statement when it goes out of scope, so it can be used
+// again and does not keep the bound strings of the caller.
+class ScopedStatementReset {
+ public:
+  explicit ScopedStatementReset(sqlite3_stmt* stmt) : stmt_(stmt) {}
+  ~ScopedStatementReset() {
+    sqlite3_reset(stmt_);
+    sqlite3_clear_bindings(stmt_);
+  }
+ private:
+  sqlite3_stmt* stmt_;
+};
+
+bool BindText(sqlite3* db, sqlite3_stmt* stmt, int index,
+              const std::string& text) {
+  int ret = sqlite3_bind_text(stmt, index, text.c_str(), text.length(),
+                              SQLITE_STATIC);
+  if (ret != SQLITE_OK) {
+    LOGGER(ERROR) << "Fail to prepare query bind argument : "
+                  << sqlite3_errmsg(db);
+    return false;
+  }
+  return true;
+}
+
+// The rows of these lists of the migration file are imported.
+const char* kMigrationLists[] = {
+  "preference",
+  "certificate",
+  "security_origin"
+};
+
+typedef std::function<bool(const picojson::value& row)> MigrationRowCallback;
+
+// Parses a list of the migration file one row at a time, so only the
+// current row is kept in memory.
+class MigrationListContext : public picojson::deny_parse_context {
+ public:
+  explicit MigrationListContext(const MigrationRowCallback& callback)
+      : callback_(callback) {}
+  // A missing list is written as null.
+  bool set_null() { return true; }
+  bool parse_array_start() { return true; }
+  template <typename Iter>
+  bool parse_array_item(picojson::input<Iter>& in, size_t) {  // NOLINT
+    picojson::value row;
+    picojson::default_parse_context ctx(&row);
+    if (!picojson::_parse(ctx, in))
+      return false;
+    return callback_(row);
+  }
+ private:
+  const MigrationRowCallback& callback_;
+};
+
+// Parses the top level object of the migration file, and skips the values
+// which are not imported without building them.
+class MigrationFileContext : public picojson::deny_parse_context {
+ public:
+  explicit MigrationFileContext(const MigrationRowCallback& callback)
+      : callback_(callback) {}
+  bool parse_object_start() { return true; }
+  template <typename Iter>
+  bool parse_object_item(picojson::input<Iter>& in,  // NOLINT
+                         const std::string& key) {
+    for (const char* list : kMigrationLists) {
+      if (key == list) {
+        MigrationListContext ctx(callback_);
+        return picojson::_parse(ctx, in);
+      }
+    }
+    picojson::null_parse_context ctx;
+    return picojson::_parse(ctx, in);
+  }
+ private:
+  const MigrationRowCallback& callback_;
+};
 #endif
 }  // namespace
 
@@ -66,8 +189,21 @@ class PreferenceAppDB : public AppDB {
                    const std::string& value);
   virtual void GetKeys(const std::string& section,
                        std::list<std::string>* keys) const;
+  virtual bool ForEach(const std::string& section,
+                       const std::string& prefix,
+                       size_t limit,
+                       const Visitor& visitor) const;
+  virtual void GetValues(const std::string& section,
+                         const std::list<std::string>& keys,
+                         std::map<std::string, std::string>* values) const;
+  virtual void SetValues(const std::string& section,
+                         const std::map<std::string, std::string>& values);
   virtual void Remove(const std::string& section,
                       const std::string& key);
+  virtual bool Apply(const Batch& batch);
+  virtual void Flush();
+  virtual void Shutdown();
+  virtual unsigned GetChangeCounter() const;
 };
 
 PreferenceAppDB::PreferenceAppDB() {
@@ -100,17 +236,65 @@ void PreferenceAppDB::Set(const std::string& section,
 
 void PreferenceAppDB::GetKeys(const std::string& section,
                               std::list<std::string>* keys) const {
+  struct Context {
+    std::string key_prefix;
+    std::list<std::string>* keys;
+  } context = { kSectionPrefix + section + kSectionSuffix, keys };
   auto callback = [](const char* key, void *user_data) {
-    auto list = static_cast<std::list<std::string>*>(user_data);
-    if (utils::StartsWith(key, list->front())) {
-      list->push_back(key+list->front().size());
+    auto context = static_cast<Context*>(user_data);
+    if (utils::StartsWith(key, context->key_prefix)) {
+      context->keys->push_back(key + context->key_prefix.size());
     }
     return true;
   };
-  std::string key_prefix = kSectionPrefix + section + kSectionSuffix;
-  keys->push_front(key_prefix);
-  preference_foreach_item(callback, keys);
-  keys->pop_front();
+  preference_foreach_item(callback, &context);
+}
+
+bool PreferenceAppDB::ForEach(const std::string& section,
+                              const std::string& prefix,
+                              size_t limit,
+                              const Visitor& visitor) const {
+  struct Context {
+    const PreferenceAppDB* db;
+    std::string section;
+    std::string key_prefix;
+    size_t section_prefix_length;
+    size_t limit;
+    size_t count;
+    const Visitor* visitor;
+  } context = {
+    this, section, kSectionPrefix + section + kSectionSuffix + prefix,
+    strlen(kSectionPrefix) + section.size() + strlen(kSectionSuffix),
+    limit, 0, &visitor
+  };
+  auto callback = [](const char* key, void *user_data) {
+    auto context = static_cast<Context*>(user_data);
+    if (!utils::StartsWith(key, context->key_prefix))
+      return true;
+    std::string section_key = key + context->section_prefix_length;
+    if (!(*context->visitor)(section_key,
+                             context->db->Get(context->section, section_key)))
+      return false;
+    return context->limit == 0 || ++context->count < context->limit;
+  };
+  return preference_foreach_item(callback, &context) == 0;
+}
+
+void PreferenceAppDB::GetValues(
+    const std::string& section,
+    const std::list<std::string>& keys,
+    std::map<std::string, std::string>* values) const {
+  for (const auto& key : keys) {
+    if (HasKey(section, key))
+      (*values)[key] = Get(section, key);
+  }
+}
+
+void PreferenceAppDB::SetValues(
+    const std::string& section,
+    const std::map<std::string, std::string>& values) {
+  for (const auto& value : values)
+    Set(section, value.first, value.second);
 }
 
 void PreferenceAppDB::Remove(const std::string& section,
@@ -119,11 +303,57 @@ void PreferenceAppDB::Remove(const std::string& section,
   preference_remove(combined_key.c_str());
 }
 
+void PreferenceAppDB::Flush() {
+}
+
+void PreferenceAppDB::Shutdown() {
+}
+
+unsigned PreferenceAppDB::GetChangeCounter() const {
+  static std::atomic<unsigned> counter(0);
+  return ++counter;
+}
+
+// app_preference has no transactions, so the changes are written one by one.
+bool PreferenceAppDB::Apply(const Batch& batch) {
+  for (const auto& op : batch.operations()) {
+    switch (op.type) {
+      case Batch::kSet:
+        Set(op.section, op.key, op.value);
+        break;
+      case Batch::kRemove:
+        Remove(op.section, op.key);
+        break;
+      case Batch::kRemoveSection: {
+        std::list<std::string> keys;
+        GetKeys(op.section, &keys);
+        for (const auto& key : keys) {
+          if (op.kept_keys.find(key) == op.kept_keys.end())
+            Remove(op.section, key);
+        }
+        break;
+      }
+    }
+  }
+  return true;
+}
+
 #else  // end of USE_APP_PREFERENCE
 
-SqliteDB::SqliteDB(const std::string& app_data_path)
+SqliteDB::SqliteDB(const std::string& app_data_path, bool write_behind)
     : app_data_path_(app_data_path),
-      sqldb_(NULL) {
+      sqldb_(NULL),
+      statements_(),
+      change_counter_(NULL),
+      write_behind_(false),
+      last_sequence_(0),
+      written_sequence_(0),
+      stopping_(false),
+      writer_stalled_(false),
+      wait_on_busy_(false),
+      flush_waiters_(0),
+      busy_count_(0),
+      deferred_count_(0) {
   if (app_data_path_.empty()) {
     std::unique_ptr<char, decltype(std::free)*>
     path {app_get_data_path(), std::free};
@@ -131,13 +361,34 @@ SqliteDB::SqliteDB(const std::string& app_data_path)
       app_data_path_ = path.get();
   }
   Initialize();
+  // Migration is done by Initialize(), before the writer starts.
+  if (write_behind && sqldb_ != NULL) {
+    write_behind_ = true;
+    std::lock_guard<std::mutex> lock(pending_mutex_);
+    StartWriter();
+  }
 }
 
 SqliteDB::~SqliteDB() {
+  Shutdown();
+  if (busy_count_ > 0) {
+    LOGGER(WARN) << "App db was busy " << busy_count_ << " times, "
+                 << deferred_count_ << " writes were deferred";
+  }
+  for (int i = 0; i < kStatementCount; ++i) {
+    if (statements_[i] != NULL) {
+      sqlite3_finalize(statements_[i]);
+      statements_[i] = NULL;
+    }
+  }
   if (sqldb_ != NULL) {
     sqlite3_close(sqldb_);
     sqldb_ = NULL;
   }
+  if (change_counter_ != NULL) {
+    munmap(change_counter_, sizeof(*change_counter_));
+    change_counter_ = NULL;
+  }
 }
 
 void SqliteDB::MigrationAppdb() {
@@ -154,50 +405,55 @@ void SqliteDB::MigrationAppdb() {
     LOGGER(ERROR) << "Fail to open file";
     return;
   }
-  picojson::value v;
-  std::string err;
-  err = picojson::parse(v, migration_file);
-  if (!err.empty()) {
-    LOGGER(ERROR) << "Fail to parse file :" << err;
-    return;
-  }
-
-  LOGGER(DEBUG) << "Start to get list data";
 
-  picojson::array data_list;
-
-  if (!v.get("preference").is<picojson::null>()) {
-    picojson::array preference_list
-      = v.get("preference").get<picojson::array>();
-    data_list.insert(data_list.end(),
-                     preference_list.begin(),
-                     preference_list.end());
-  }
-  if (!v.get("certificate").is<picojson::null>()) {
-    picojson::array certificate_list
-      = v.get("certificate").get<picojson::array>();
-    data_list.insert(data_list.end(),
-                     certificate_list.begin(),
-                     certificate_list.end());
-  }
-  if (!v.get("security_origin").is<picojson::null>()) {
-    picojson::array security_origin_list
-      = v.get("security_origin").get<picojson::array>();
-    data_list.insert(data_list.end(),
-                     security_origin_list.begin(),
-                     security_origin_list.end());
+  // The rows are written while the file is parsed, all in one transaction,
+  // so a large file is neither kept in memory nor committed row by row.
+  // This runs from Initialize(), before the writer thread is started.
+  std::lock_guard<std::mutex> lock(db_mutex_);
+  sqlite3_stmt* stmt = GetStatement(kSetStatement);
+  if (stmt == NULL)
+    return;
+  if (!Execute("begin immediate transaction")) {
+    LOGGER(ERROR) << "Fail to migrate the app db";
+    return;
   }
 
-  for (auto it = data_list.begin(); it != data_list.end(); ++it) {
-    if (!it->is<picojson::object>()) continue;
-    std::string section = it->get("section").to_str();
-    std::string key = it->get("key").to_str();
-    std::string value = it->get("value").to_str();
+  size_t count = 0;
+  MigrationRowCallback insert_row = [&](const picojson::value& row) {
+    if (!row.is<picojson::object>())
+      return true;
+    ScopedStatementReset reset(stmt);
+    // The strings must live until the statement is stepped.
+    std::string section = row.get("section").to_str();
+    std::string key = row.get("key").to_str();
+    std::string value = row.get("value").to_str();
+    if (!BindText(sqldb_, stmt, 1, section) ||
+        !BindText(sqldb_, stmt, 2, key) ||
+        !BindText(sqldb_, stmt, 3, value))
+      return false;
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+      LOGGER(ERROR) << "Fail to write data : " << sqlite3_errmsg(sqldb_);
+      return false;
+    }
+    ++count;
+    return true;
+  };
 
-    LOGGER(DEBUG) << "INPUT[" << section << "][" << key << "][" << value << "]";
-    Set(section, key, value);
+  MigrationFileContext ctx(insert_row);
+  std::string err;
+  picojson::_parse(ctx, std::istreambuf_iterator<char>(migration_file.rdbuf()),
+                   std::istreambuf_iterator<char>(), &err);
+  // The migration file is kept to retry on the next launch.
+  if (!err.empty() || !Execute("commit transaction")) {
+    if (!err.empty())
+      LOGGER(ERROR) << "Fail to parse file :" << err;
+    LOGGER(ERROR) << "Fail to migrate the app db";
+    Execute("rollback transaction");
+    return;
   }
+  NotifyChanged();
 
+  LOGGER(DEBUG) << count << " rows are migrated";
   LOGGER(DEBUG) << "Migration complete";
 
   if (0 != remove(migration_path.c_str())) {
@@ -218,16 +474,20 @@ void SqliteDB::Initialize() {
     sqldb_ = NULL;
     return;
   }
-  sqlite3_busy_handler(sqldb_, [](void *, int count) {
-    if (count < 5) {
-      LOGGER(ERROR) << "App db was busy, Wait the lock count(" << count << ")";
-      usleep(100000*(count+1));
-      return 1;
-    } else {
-      LOGGER(ERROR) << "App db was busy, Fail to access";
+  // Waiting for the lock here would block the calling thread, which is
+  // usually the main loop, so a busy write fails at once and is retried by
+  // the writer thread, see Write(). A read only waits a few milliseconds.
+  sqlite3_busy_handler(sqldb_, [](void* data, int count) {
+    SqliteDB* self = static_cast<SqliteDB*>(data);
+    ++self->busy_count_;
+    if (!self->wait_on_busy_ || count >= kBusyWaitRetries)
       return 0;
-    }
-  }, NULL);
+    usleep(kBusyWaitUs);
+    return 1;
+  }, this);
+
+  Execute(kJournalModeQuery);
+  Execute(kSynchronousQuery);
 
   char *errmsg = NULL;
   ret = sqlite3_exec(sqldb_, kCreateDbQuery, NULL, NULL, &errmsg);
@@ -236,211 +496,744 @@ void SqliteDB::Initialize() {
     if (errmsg)
       sqlite3_free(errmsg);
   }
+  if (!PrepareStatements())
+    return;
+  OpenChangeCounter();
   MigrationAppdb();
 }
 
+void SqliteDB::OpenChangeCounter() {
+  std::string counter_path = app_data_path_ + "/.appdb.counter";
+  int fd = open(counter_path.c_str(), O_RDWR | O_CREAT, 0600);
+  if (fd < 0) {
+    LOGGER(ERROR) << "Fail to open the app db change counter";
+    return;
+  }
+  if (ftruncate(fd, sizeof(*change_counter_)) == 0) {
+    void* counter = mmap(NULL, sizeof(*change_counter_),
+                         PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (counter != MAP_FAILED)
+      change_counter_ = static_cast<unsigned*>(counter);
+  }
+  close(fd);
+  if (change_counter_ == NULL)
+    LOGGER(ERROR) << "Fail to map the app db change counter";
+}
+
+void SqliteDB::NotifyChanged() {
+  if (change_counter_ != NULL)
+    __atomic_add_fetch(change_counter_, 1, __ATOMIC_SEQ_CST);
+}
+
+unsigned SqliteDB::GetChangeCounter() const {
+  if (change_counter_ == NULL) {
+    static std::atomic<unsigned> counter(0);
+    return ++counter;
+  }
+  return __atomic_load_n(change_counter_, __ATOMIC_SEQ_CST);
+}
+
+bool SqliteDB::PrepareStatements() {
+  static_assert(
+      sizeof(kStatementQueries) / sizeof(kStatementQueries[0]) ==
+          kStatementCount,
+      "kStatementQueries must have a query for each StatementType");
+  for (int i = 0; i < kStatementCount; ++i) {
+    int ret = sqlite3_prepare_v2(sqldb_, kStatementQueries[i], -1,
+                                 &statements_[i], NULL);
+    if (ret != SQLITE_OK) {
+      LOGGER(ERROR) << "Fail to prepare query : " << sqlite3_errmsg(sqldb_);
+      statements_[i] = NULL;
+      return false;
+    }
+  }
+  return true;
+}
+
+sqlite3_stmt* SqliteDB::GetStatement(StatementType type) const {
+  if (statements_[type] == NULL)
+    LOGGER(ERROR) << "App db was not initialized";
+  return statements_[type];
+}
+
 bool SqliteDB::HasKey(const std::string& section,
                       const std::string& key) const {
-  char *buffer = NULL;
-  sqlite3_stmt *stmt = NULL;
-  bool result = false;
+  std::lock_guard<std::mutex> pending_lock(pending_mutex_);
+  auto it = pending_writes_.find(SectionKey(section, key));
+  if (it != pending_writes_.end())
+    return !it->second.removed;
 
-  int ret = 0;
-  buffer = sqlite3_mprintf(
-      "select count(*) from appdb where section = %Q and key = %Q",
-      section.c_str(),
-      key.c_str());
-  if (buffer == NULL) {
-    LOGGER(ERROR) << "error to make query";
+  std::lock_guard<std::mutex> lock(db_mutex_);
+  sqlite3_stmt* stmt = GetStatement(kHasKeyStatement);
+  if (stmt == NULL)
     return false;
-  }
-
-  std::unique_ptr<char, decltype(sqlite3_free)*>
-      scoped_data {buffer, sqlite3_free};
+  ScopedStatementReset reset(stmt);
+  ScopedFlag wait_on_busy(&wait_on_busy_);
 
-  ret = sqlite3_prepare(sqldb_, buffer, strlen(buffer), &stmt, NULL);
-  if (ret != SQLITE_OK) {
-    LOGGER(ERROR) << "Fail to prepare query : " << sqlite3_errmsg(sqldb_);
+  if (!BindText(sqldb_, stmt, 1, section) || !BindText(sqldb_, stmt, 2, key))
     return false;
-  }
 
-  ret = sqlite3_step(stmt);
+  bool result = false;
+  int ret = sqlite3_step(stmt);
   if (ret == SQLITE_ROW) {
     int value = sqlite3_column_int(stmt, 0);
     result = value > 0;
+  } else if (IsBusy()) {
+    LogBusy("read");
   }
-
-  sqlite3_finalize(stmt);
   return result;
 }
 
 std::string SqliteDB::Get(const std::string& section,
                           const std::string& key) const {
-  char *buffer = NULL;
-  sqlite3_stmt *stmt = NULL;
   std::string result;
-
-  int ret = 0;
-  buffer = sqlite3_mprintf(
-      "select value from appdb where section = %Q and key = %Q",
-      section.c_str(),
-      key.c_str());
-  if (buffer == NULL) {
-    LOGGER(ERROR) << "error to make query";
+  std::lock_guard<std::mutex> pending_lock(pending_mutex_);
+  auto it = pending_writes_.find(SectionKey(section, key));
+  if (it != pending_writes_.end()) {
+    if (!it->second.removed)
+      result = it->second.value;
     return result;
   }
 
-  std::unique_ptr<char, decltype(sqlite3_free)*>
-      scoped_data {buffer, sqlite3_free};
+  std::lock_guard<std::mutex> lock(db_mutex_);
+  sqlite3_stmt* stmt = GetStatement(kGetStatement);
+  if (stmt == NULL)
+    return result;
+  ScopedStatementReset reset(stmt);
+  ScopedFlag wait_on_busy(&wait_on_busy_);
 
-  ret = sqlite3_prepare(sqldb_, buffer, strlen(buffer), &stmt, NULL);
-  if (ret != SQLITE_OK) {
-    LOGGER(ERROR) << "Fail to prepare query : " << sqlite3_errmsg(sqldb_);
+  if (!BindText(sqldb_, stmt, 1, section) || !BindText(sqldb_, stmt, 2, key))
     return result;
-  }
 
-  ret = sqlite3_step(stmt);
+  int ret = sqlite3_step(stmt);
   if (ret == SQLITE_ROW) {
-    result = std::string(
-        reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)));
+    const char* value =
+        reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+    if (value != NULL)
+      result = std::string(value, sqlite3_column_bytes(stmt, 0));
+  } else if (IsBusy()) {
+    LogBusy("read");
   }
-
-  sqlite3_finalize(stmt);
   return result;
 }
 
 void SqliteDB::Set(const std::string& section,
                    const std::string& key,
                    const std::string& value) {
-  char *buffer = NULL;
-  sqlite3_stmt *stmt = NULL;
+  Batch batch;
+  batch.Set(section, key, value);
+  Write(batch.operations());
+}
 
-  int ret = 0;
-  buffer = sqlite3_mprintf(
-      "replace into appdb (section, key, value) values (?, ?, ?);");
-  if (buffer == NULL) {
-    LOGGER(ERROR) << "error to make query";
-    return;
-  }
+void SqliteDB::Remove(const std::string& section,
+                      const std::string& key) {
+  Batch batch;
+  batch.Remove(section, key);
+  Write(batch.operations());
+}
 
-  std::unique_ptr<char, decltype(sqlite3_free)*>
-      scoped_data {buffer, sqlite3_free};
+void SqliteDB::GetKeys(const std::string& section,
+                       std::list<std::string>* keys) const {
+  std::lock_guard<std::mutex> pending_lock(pending_mutex_);
+  GetKeysLocked(section, keys);
+}
 
-  ret = sqlite3_prepare(sqldb_, buffer, strlen(buffer), &stmt, NULL);
-  if (ret != SQLITE_OK) {
-    LOGGER(ERROR) << "Fail to prepare query : " << sqlite3_errmsg(sqldb_);
-    return;
-  }
+void SqliteDB::GetKeysLocked(const std::string& section,
+                             std::list<std::string>* keys) const {
+  std::list<std::string> stored_keys;
+  {
+    std::lock_guard<std::mutex> lock(db_mutex_);
+    sqlite3_stmt* stmt = GetStatement(kGetKeysStatement);
+    if (stmt == NULL)
+      return;
+    ScopedStatementReset reset(stmt);
+    ScopedFlag wait_on_busy(&wait_on_busy_);
 
-  std::unique_ptr<sqlite3_stmt, decltype(sqlite3_finalize)*>
-      scoped_stmt {stmt, sqlite3_finalize};
+    if (!BindText(sqldb_, stmt, 1, section))
+      return;
 
-  ret = sqlite3_bind_text(stmt,
-                          1,
-                          section.c_str(),
-                          section.length(),
-                          SQLITE_STATIC);
-  if (ret != SQLITE_OK) {
-    LOGGER(ERROR) << "Fail to prepare query bind argument : "
-                  << sqlite3_errmsg(sqldb_);
-    return;
+    int ret = sqlite3_step(stmt);
+    while (ret == SQLITE_ROW) {
+      const char* value =
+          reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+      stored_keys.push_back(std::string(value));
+      ret = sqlite3_step(stmt);
+    }
+    if (ret != SQLITE_DONE && IsBusy())
+      LogBusy("read");
   }
-  ret = sqlite3_bind_text(stmt,
-                          2,
-                          key.c_str(),
-                          key.length(),
-                          SQLITE_STATIC);
-  if (ret != SQLITE_OK) {
-    LOGGER(ERROR) << "Fail to prepare query bind argument : "
-                  << sqlite3_errmsg(sqldb_);
+
+  if (pending_writes_.empty()) {
+    keys->splice(keys->end(), stored_keys);
     return;
   }
-  ret = sqlite3_bind_text(stmt,
-                          3,
-                          value.c_str(),
-                          value.length(),
-                          SQLITE_STATIC);
+  // Merge the changes which are not written yet.
+  auto begin = pending_writes_.lower_bound(SectionKey(section, ""));
+  auto end = begin;
+  while (end != pending_writes_.end() && end->first.first == section)
+    ++end;
+  for (const auto& key : stored_keys) {
+    auto it = pending_writes_.find(SectionKey(section, key));
+    if (it == pending_writes_.end() || !it->second.removed)
+      keys->push_back(key);
+  }
+  for (auto it = begin; it != end; ++it) {
+    if (!it->second.removed &&
+        std::find(stored_keys.begin(), stored_keys.end(),
+                  it->first.second) == stored_keys.end())
+      keys->push_back(it->first.second);
+  }
+}
+
+bool SqliteDB::ForEachRow(
+    const std::function<void(const std::string& section,
+                             const std::string& key,
+                             const std::string& value)>& callback) {
+  Flush();
+  std::lock_guard<std::mutex> lock(db_mutex_);
+  if (sqldb_ == NULL)
+    return false;
+  sqlite3_stmt* stmt = NULL;
+  int ret = sqlite3_prepare_v2(sqldb_,
+                               "select section, key, value from appdb",
+                               -1, &stmt, NULL);
   if (ret != SQLITE_OK) {
-    LOGGER(ERROR) << "Fail to prepare query bind argument : "
-                  << sqlite3_errmsg(sqldb_);
-    return;
+    LOGGER(ERROR) << "Fail to prepare query : " << sqlite3_errmsg(sqldb_);
+    return false;
   }
-  ret = sqlite3_step(stmt);
+  std::unique_ptr<sqlite3_stmt, decltype(sqlite3_finalize)*>
+      scoped_stmt {stmt, sqlite3_finalize};
+
+  auto column = [stmt](int index) {
+    const char* text =
+        reinterpret_cast<const char*>(sqlite3_column_text(stmt, index));
+    return text ? std::string(text, sqlite3_column_bytes(stmt, index))
+                : std::string();
+  };
+  ScopedFlag wait_on_busy(&wait_on_busy_);
+  while ((ret = sqlite3_step(stmt)) == SQLITE_ROW)
+    callback(column(0), column(1), column(2));
   if (ret != SQLITE_DONE) {
-    LOGGER(ERROR) << "Fail to insert data : " << sqlite3_errmsg(sqldb_);
+    LOGGER(ERROR) << "Fail to read the rows : " << sqlite3_errmsg(sqldb_);
+    return false;
   }
+  return true;
 }
 
-void SqliteDB::Remove(const std::string& section,
-                      const std::string& key) {
-  char *buffer = NULL;
+// The stored keys and the changes which are not written yet are both in key
+// order, and are merged as they are read.
+bool SqliteDB::ForEach(const std::string& section,
+                       const std::string& prefix,
+                       size_t limit,
+                       const Visitor& visitor) const {
+  std::lock_guard<std::mutex> pending_lock(pending_mutex_);
+  std::lock_guard<std::mutex> lock(db_mutex_);
+  sqlite3_stmt* stmt = GetStatement(kForEachStatement);
+  if (stmt == NULL)
+    return false;
+  ScopedStatementReset reset(stmt);
+  ScopedFlag wait_on_busy(&wait_on_busy_);
+
+  if (!BindText(sqldb_, stmt, 1, section) ||
+      !BindText(sqldb_, stmt, 2, prefix))
+    return false;
+
+  auto pending = pending_writes_.lower_bound(SectionKey(section, prefix));
+  auto has_pending = [&]() {
+    return pending != pending_writes_.end() &&
+           pending->first.first == section &&
+           utils::StartsWith(pending->first.second, prefix);
+  };
 
-  buffer = sqlite3_mprintf(
-      "delete from appdb where section = %Q and key = %Q",
-      section.c_str(),
-      key.c_str());
+  size_t count = 0;
+  int ret = sqlite3_step(stmt);
+  while (limit == 0 || count < limit) {
+    const char* key = NULL;
+    if (ret == SQLITE_ROW) {
+      key = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+      if (!utils::StartsWith(key, prefix))
+        key = NULL;
+    }
+    if (key == NULL && !has_pending())
+      break;
 
-  if (buffer == NULL) {
-    LOGGER(ERROR) << "error to make query";
+    bool visited;
+    if (has_pending() && (key == NULL || pending->first.second <= key)) {
+      if (key != NULL && pending->first.second == key)
+        ret = sqlite3_step(stmt);
+      visited = !pending->second.removed;
+      if (visited && !visitor(pending->first.second, pending->second.value))
+        return true;
+      ++pending;
+    } else {
+      const char* value =
+          reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+      visited = true;
+      if (!visitor(key, value ? std::string(value,
+                                            sqlite3_column_bytes(stmt, 1))
+                              : std::string()))
+        return true;
+      ret = sqlite3_step(stmt);
+    }
+    if (visited)
+      ++count;
+  }
+  if (ret != SQLITE_ROW && ret != SQLITE_DONE) {
+    if (IsBusy())
+      LogBusy("read");
+    else
+      LOGGER(ERROR) << "Fail to read the keys : " << sqlite3_errmsg(sqldb_);
+    return false;
+  }
+  return true;
+}
+
+void SqliteDB::GetValues(const std::string& section,
+                         const std::list<std::string>& keys,
+                         std::map<std::string, std::string>* values) const {
+  std::lock_guard<std::mutex> pending_lock(pending_mutex_);
+  std::lock_guard<std::mutex> lock(db_mutex_);
+  sqlite3_stmt* stmt = GetStatement(kGetStatement);
+  if (stmt == NULL)
     return;
+  ScopedFlag wait_on_busy(&wait_on_busy_);
+
+  for (const auto& key : keys) {
+    auto it = pending_writes_.find(SectionKey(section, key));
+    if (it != pending_writes_.end()) {
+      if (!it->second.removed)
+        (*values)[key] = it->second.value;
+      continue;
+    }
+
+    ScopedStatementReset reset(stmt);
+    if (!BindText(sqldb_, stmt, 1, section) || !BindText(sqldb_, stmt, 2, key))
+      return;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+      const char* value =
+          reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+      (*values)[key] =
+          value ? std::string(value, sqlite3_column_bytes(stmt, 0))
+                : std::string();
+    }
   }
+}
 
-  std::unique_ptr<char, decltype(sqlite3_free)*>
-      scoped_data {buffer, sqlite3_free};
+void SqliteDB::SetValues(const std::string& section,
+                         const std::map<std::string, std::string>& values) {
+  Batch batch;
+  for (const auto& value : values)
+    batch.Set(section, value.first, value.second);
+  Apply(batch);
+}
 
+bool SqliteDB::Execute(const char* query) {
   char *errmsg = NULL;
-  int ret = sqlite3_exec(sqldb_, buffer, NULL, NULL, &errmsg);
+  int ret = sqlite3_exec(sqldb_, query, NULL, NULL, &errmsg);
   if (ret != SQLITE_OK) {
-    LOGGER(ERROR) << "Error to delete value : " << (errmsg ? errmsg : "");
+    LOGGER(ERROR) << "Fail to execute " << query << " : "
+                  << (errmsg ? errmsg : "");
     if (errmsg)
       sqlite3_free(errmsg);
+    return false;
   }
+  return true;
 }
 
-void SqliteDB::GetKeys(const std::string& section,
-                       std::list<std::string>* keys) const {
-  char *buffer = NULL;
-  sqlite3_stmt *stmt = NULL;
-
-  int ret = 0;
-  buffer = sqlite3_mprintf(
-      "select key from appdb where section = %Q",
-      section.c_str());
-  if (buffer == NULL) {
-    LOGGER(ERROR) << "error to make query";
-    return;
+bool SqliteDB::ApplyOperation(const Batch::Operation& op) {
+  switch (op.type) {
+    case Batch::kSet:
+    case Batch::kRemove: {
+      sqlite3_stmt* stmt = GetStatement(
+          op.type == Batch::kSet ? kSetStatement : kRemoveStatement);
+      if (stmt == NULL)
+        return false;
+      ScopedStatementReset reset(stmt);
+      if (!BindText(sqldb_, stmt, 1, op.section) ||
+          !BindText(sqldb_, stmt, 2, op.key))
+        return false;
+      if (op.type == Batch::kSet && !BindText(sqldb_, stmt, 3, op.value))
+        return false;
+      if (sqlite3_step(stmt) != SQLITE_DONE) {
+        LOGGER(ERROR) << "Fail to write data : " << sqlite3_errmsg(sqldb_);
+        return false;
+      }
+      return true;
+    }
+    case Batch::kRemoveSection:
+      break;
   }
 
-  std::unique_ptr<char, decltype(sqlite3_free)*>
-      scoped_data {buffer, sqlite3_free};
+  // The number of kept keys varies, so this statement is not cached.
+  std::string query = "delete from appdb where section = ?";
+  if (!op.kept_keys.empty()) {
+    query += " and key not in (?";
+    for (size_t i = 1; i < op.kept_keys.size(); ++i)
+      query += ", ?";
+    query += ")";
+  }
 
-  ret = sqlite3_prepare(sqldb_, buffer, strlen(buffer), &stmt, NULL);
+  sqlite3_stmt *stmt = NULL;
+  int ret = sqlite3_prepare_v2(sqldb_, query.c_str(), query.length(),
+                               &stmt, NULL);
   if (ret != SQLITE_OK) {
     LOGGER(ERROR) << "Fail to prepare query : " << sqlite3_errmsg(sqldb_);
-    return;
+    return false;
+  }
+  std::unique_ptr<sqlite3_stmt, decltype(sqlite3_finalize)*>
+      scoped_stmt {stmt, sqlite3_finalize};
+
+  int index = 1;
+  if (!BindText(sqldb_, stmt, index++, op.section))
+    return false;
+  for (const auto& key : op.kept_keys) {
+    if (!BindText(sqldb_, stmt, index++, key))
+      return false;
   }
 
   ret = sqlite3_step(stmt);
-  while (ret == SQLITE_ROW) {
-    const char* value =
-        reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
-    keys->push_back(std::string(value));
-    ret = sqlite3_step(stmt);
+  if (ret != SQLITE_DONE) {
+    LOGGER(ERROR) << "Fail to delete data : " << sqlite3_errmsg(sqldb_);
+    return false;
+  }
+  return true;
+}
+
+bool SqliteDB::ApplyOperations(
+    const std::vector<Batch::Operation>& operations, bool* busy) {
+  *busy = false;
+  // A single change does not need an explicit transaction.
+  if (operations.size() == 1 &&
+      operations.front().type != Batch::kRemoveSection) {
+    if (!ApplyOperation(operations.front())) {
+      *busy = IsBusy();
+      return false;
+    }
+    NotifyChanged();
+    return true;
+  }
+
+  if (!Execute("begin immediate transaction")) {
+    *busy = IsBusy();
+    return false;
+  }
+  for (const auto& op : operations) {
+    if (!ApplyOperation(op)) {
+      *busy = IsBusy();
+      Execute("rollback transaction");
+      return false;
+    }
+  }
+  if (!Execute("commit transaction")) {
+    *busy = IsBusy();
+    Execute("rollback transaction");
+    return false;
+  }
+  NotifyChanged();
+  return true;
+}
+
+bool SqliteDB::IsBusy() const {
+  int code = sqlite3_errcode(sqldb_);
+  return code == SQLITE_BUSY || code == SQLITE_LOCKED;
+}
+
+void SqliteDB::LogBusy(const char* operation) const {
+  LOGGER(WARN) << "App db was busy, fail to " << operation
+               << " (busy " << busy_count_ << ", deferred "
+               << deferred_count_ << ")";
+}
+
+bool SqliteDB::Write(const std::vector<Batch::Operation>& operations) {
+  if (sqldb_ == NULL) {
+    LOGGER(ERROR) << "App db was not initialized";
+    return false;
+  }
+
+  {
+    // Changes queued before must be written first.
+    std::lock_guard<std::mutex> lock(pending_mutex_);
+    if (write_behind_ || last_sequence_ != written_sequence_) {
+      EnqueueLocked(operations);
+      return true;
+    }
+  }
+
+  bool busy;
+  {
+    std::lock_guard<std::mutex> lock(db_mutex_);
+    if (ApplyOperations(operations, &busy))
+      return true;
+  }
+  if (!busy)
+    return false;
+
+  // Another process holds the lock. The writer thread waits for it, so the
+  // caller does not.
+  std::lock_guard<std::mutex> lock(pending_mutex_);
+  if (stopping_) {
+    // The writer was stopped by Shutdown().
+    std::lock_guard<std::mutex> db_lock(db_mutex_);
+    ScopedFlag wait_on_busy(&wait_on_busy_);
+    if (ApplyOperations(operations, &busy))
+      return true;
+    if (busy)
+      LogBusy("write after shutdown");
+    return false;
+  }
+  ++deferred_count_;
+  LogBusy("write, the write is deferred");
+  EnqueueLocked(operations);
+  return true;
+}
+
+// The caller of Apply() needs to know whether the changes are written, so
+// they are never left queued. The changes queued before are flushed first,
+// and the batch fails if they are still not written.
+bool SqliteDB::Apply(const Batch& batch) {
+  if (batch.empty())
+    return true;
+  if (sqldb_ == NULL) {
+    LOGGER(ERROR) << "App db was not initialized";
+    return false;
   }
 
-  sqlite3_finalize(stmt);
-  return;
+  std::unique_lock<std::mutex> lock(pending_mutex_);
+  if (last_sequence_ != written_sequence_) {
+    FlushLocked(&lock);
+    if (last_sequence_ != written_sequence_) {
+      LogBusy("apply, earlier changes are still queued");
+      return false;
+    }
+  }
+  std::lock_guard<std::mutex> db_lock(db_mutex_);
+  ScopedFlag wait_on_busy(&wait_on_busy_);
+  bool busy;
+  if (ApplyOperations(batch.operations(), &busy))
+    return true;
+  if (busy)
+    LogBusy("apply");
+  return false;
+}
+
+void SqliteDB::StartWriter() {
+  if (!writer_.joinable() && !stopping_)
+    writer_ = std::thread(&SqliteDB::WriterMain, this);
+}
+
+// The operations are queued together, so the writer commits them in the
+// same transaction. Keys removed with a section are looked up now, so the
+// reads see them removed before the section is written.
+void SqliteDB::EnqueueLocked(const std::vector<Batch::Operation>& operations) {
+  for (const auto& op : operations) {
+    unsigned sequence = ++last_sequence_;
+    pending_operations_.push_back(op);
+    if (op.type == Batch::kRemoveSection) {
+      std::list<std::string> keys;
+      GetKeysLocked(op.section, &keys);
+      for (const auto& key : keys) {
+        if (op.kept_keys.find(key) != op.kept_keys.end())
+          continue;
+        PendingWrite& pending = pending_writes_[SectionKey(op.section, key)];
+        pending.removed = true;
+        pending.value.clear();
+        pending.sequence = sequence;
+      }
+      continue;
+    }
+    PendingWrite& pending = pending_writes_[SectionKey(op.section, op.key)];
+    pending.removed = op.type == Batch::kRemove;
+    pending.value = op.value;
+    pending.sequence = sequence;
+  }
+  writer_stalled_ = false;
+  StartWriter();
+  pending_cond_.notify_one();
+}
+
+void SqliteDB::Flush() {
+  std::unique_lock<std::mutex> lock(pending_mutex_);
+  FlushLocked(&lock);
+}
+
+// The writer writes the queued changes before it quits. It is not started
+// again, so later writes wait for a busy db themselves.
+void SqliteDB::Shutdown() {
+  std::unique_lock<std::mutex> lock(pending_mutex_);
+  stopping_ = true;
+  write_behind_ = false;
+  if (!writer_.joinable())
+    return;
+  lock.unlock();
+  pending_cond_.notify_one();
+  writer_.join();
+}
+
+// The writer tries the queued changes once more, at once, even if it gave
+// up on a busy db or waits to retry. If the db is still busy, it stalls and
+// the changes stay queued, so a flush waits for a single attempt.
+void SqliteDB::FlushLocked(std::unique_lock<std::mutex>* lock) {
+  if (!writer_.joinable() || written_sequence_ == last_sequence_)
+    return;
+  ++flush_waiters_;
+  writer_stalled_ = false;
+  pending_cond_.notify_one();
+  unsigned sequence = last_sequence_;
+  flushed_cond_.wait(*lock, [this, sequence] {
+    return written_sequence_ >= sequence || writer_stalled_;
+  });
+  --flush_waiters_;
+}
+
+// Writes the queued changes in one transaction each time it wakes up, so
+// a burst of changes costs a single commit. While another process holds the
+// lock, the changes are retried with a growing delay. After kMaxBusyRetries,
+// or at once when a Flush() waits, the writer stalls, the changes are kept
+// queued, and it retries on the next write or Flush().
+void SqliteDB::WriterMain() {
+  const int kMaxBusyRetries = 5;
+  int busy_retries = 0;
+  std::unique_lock<std::mutex> lock(pending_mutex_);
+  while (true) {
+    pending_cond_.wait(lock, [this] {
+      return stopping_ ||
+             (!pending_operations_.empty() && !writer_stalled_);
+    });
+    if (pending_operations_.empty())
+      break;
+
+    std::vector<Batch::Operation> operations;
+    operations.swap(pending_operations_);
+    unsigned sequence = last_sequence_;
+    lock.unlock();
+    bool written;
+    bool busy;
+    {
+      std::lock_guard<std::mutex> db_lock(db_mutex_);
+      written = ApplyOperations(operations, &busy);
+    }
+    lock.lock();
+
+    if (!written && busy && (busy_retries < kMaxBusyRetries || !stopping_)) {
+      pending_operations_.insert(pending_operations_.begin(),
+                                 operations.begin(), operations.end());
+      if (busy_retries < kMaxBusyRetries && flush_waiters_ == 0) {
+        ++busy_retries;
+        LogBusy("write, retry later");
+        pending_cond_.wait_for(
+            lock, std::chrono::milliseconds(100 * busy_retries),
+            [this] { return flush_waiters_ > 0; });
+      } else {
+        busy_retries = 0;
+        LogBusy("write, retry on the next flush");
+        writer_stalled_ = true;
+        flushed_cond_.notify_all();
+      }
+      continue;
+    }
+    busy_retries = 0;
+
+    if (!written) {
+      LOGGER(ERROR) << "Fail to write " << operations.size()
+                    << " queued changes, they are dropped";
+    }
+    // Later changes of the same keys are still pending.
+    for (auto it = pending_writes_.begin(); it != pending_writes_.end(); ) {
+      if (it->second.sequence <= sequence)
+        it = pending_writes_.erase(it);
+      else
+        ++it;
+    }
+    written_sequence_ = sequence;
+    flushed_cond_.notify_all();
+  }
 }
 
 #endif  // end of else
 
+void AppDB::Batch::Set(const std::string& section,
+                       const std::string& key,
+                       const std::string& value) {
+  Operation op;
+  op.type = kSet;
+  op.section = section;
+  op.key = key;
+  op.value = value;
+  operations_.push_back(op);
+}
+
+void AppDB::Batch::Remove(const std::string& section,
+                          const std::string& key) {
+  Operation op;
+  op.type = kRemove;
+  op.section = section;
+  op.key = key;
+  operations_.push_back(op);
+}
+
+void AppDB::Batch::RemoveSection(const std::string& section,
+                                 const std::set<std::string>& kept_keys) {
+  Operation op;
+  op.type = kRemoveSection;
+  op.section = section;
+  op.kept_keys = kept_keys;
+  operations_.push_back(op);
+}
+
+AppDB::Transaction::Transaction(AppDB* db)
+    : db_(db) {
+}
+
+AppDB::Transaction::~Transaction() {
+  if (!batch_.empty()) {
+    LOGGER(WARN) << "Drop " << batch_.operations().size()
+                 << " uncommitted app db changes";
+  }
+}
+
+void AppDB::Transaction::Set(const std::string& section,
+                             const std::string& key,
+                             const std::string& value) {
+  batch_.Set(section, key, value);
+}
+
+void AppDB::Transaction::Remove(const std::string& section,
+                                const std::string& key) {
+  batch_.Remove(section, key);
+}
+
+void AppDB::Transaction::RemoveSection(
+    const std::string& section,
+    const std::set<std::string>& kept_keys) {
+  batch_.RemoveSection(section, kept_keys);
+}
+
+bool AppDB::Transaction::Commit() {
+  bool result = db_->Apply(batch_);
+  batch_ = Batch();
+  return result;
+}
+
+// Never destroyed, the writer thread is stopped by Shutdown() instead of a
+// static destructor.
 AppDB* AppDB::GetInstance() {
 #ifdef USE_APP_PREFERENCE
-  static PreferenceAppDB instance;
+  static AppDB* instance = new PreferenceAppDB;
+#elif defined(USE_APP_LOG_DB)
+  static AppDB* instance = new LogAppDB;
+#else
+#ifdef APPDB_WRITE_BEHIND
+  static AppDB* instance = new SqliteDB(std::string(), true);
+#else
+  static AppDB* instance = new SqliteDB;
+#endif
+#endif
+#ifdef APPDB_CACHE
+  static AppDB* cached_instance = new CachedAppDB(instance);
+  return cached_instance;
 #else
-  static SqliteDB instance;
+  return instance;
 #endif
-  return &instance;
 }
 
 }  // namespace common
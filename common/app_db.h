@@ -17,14 +17,79 @@
 #ifndef XWALK_COMMON_APP_DB_H_
 #define XWALK_COMMON_APP_DB_H_
 
+#include <functional>
 #include <list>
+#include <map>
+#include <set>
 #include <string>
+#include <vector>
 
 namespace common {
 
 class AppDB {
  public:
+  // A list of changes which AppDB::Apply() writes at once. The changes are
+  // applied in the order they were added.
+  class Batch {
+   public:
+    enum OperationType {
+      kSet,
+      kRemove,
+      kRemoveSection
+    };
+    struct Operation {
+      OperationType type;
+      std::string section;
+      std::string key;
+      std::string value;
+      std::set<std::string> kept_keys;
+    };
+
+    void Set(const std::string& section,
+             const std::string& key,
+             const std::string& value);
+    void Remove(const std::string& section,
+                const std::string& key);
+    // Removes every key of |section| except for |kept_keys|.
+    void RemoveSection(const std::string& section,
+                       const std::set<std::string>& kept_keys);
+
+    bool empty() const { return operations_.empty(); }
+    const std::vector<Operation>& operations() const { return operations_; }
+
+   private:
+    std::vector<Operation> operations_;
+  };
+
+  // Collects changes which are written in one batch by Commit(). Changes
+  // which are not committed when the scope is left are dropped. Reads do not
+  // see the changes before they are committed.
+  class Transaction {
+   public:
+    explicit Transaction(AppDB* db);
+    ~Transaction();
+
+    void Set(const std::string& section,
+             const std::string& key,
+             const std::string& value);
+    void Remove(const std::string& section,
+                const std::string& key);
+    void RemoveSection(const std::string& section,
+                       const std::set<std::string>& kept_keys);
+    bool Commit();
+
+   private:
+    AppDB* db_;
+    Batch batch_;
+  };
+
+  // Called with each visited key and its value. Returning false stops the
+  // iteration. The visitor must not use the AppDB.
+  typedef std::function<bool(const std::string& key,
+                             const std::string& value)> Visitor;
+
   static AppDB* GetInstance();
+  virtual ~AppDB() {}
   virtual bool HasKey(const std::string& section,
                       const std::string& key) const = 0;
   virtual std::string Get(const std::string& section,
@@ -34,8 +99,34 @@ class AppDB {
                    const std::string& value) = 0;
   virtual void GetKeys(const std::string& section,
                        std::list<std::string>* keys) const = 0;
+  // Visits the keys of |section| which start with |prefix|, at most |limit|
+  // of them unless it is 0, without copying the section. Returns false if
+  // the keys could not all be read; a visitor stopping early is no failure.
+  virtual bool ForEach(const std::string& section,
+                       const std::string& prefix,
+                       size_t limit,
+                       const Visitor& visitor) const = 0;
+  // Adds the values of the |keys| of |section| to |values|. Missing keys are
+  // left out.
+  virtual void GetValues(const std::string& section,
+                         const std::list<std::string>& keys,
+                         std::map<std::string, std::string>* values) const = 0;
+  virtual void SetValues(
+      const std::string& section,
+      const std::map<std::string, std::string>& values) = 0;
   virtual void Remove(const std::string& section,
                       const std::string& key) = 0;
+  // Writes all the changes of |batch|, in a single transaction where the
+  // backend supports one. Returns false if the changes were not written.
+  virtual bool Apply(const Batch& batch) = 0;
+  // Blocks until the changes queued by a write-behind backend are written.
+  virtual void Flush() = 0;
+  // Writes the queued changes and stops the threads of the backend, before
+  // the process exits. Later changes are written before the call returns.
+  virtual void Shutdown() = 0;
+  // Returns a number which changes whenever the db is written, also by other
+  // processes. Backends which can not tell return a new number on each call.
+  virtual unsigned GetChangeCounter() const = 0;
 };
 }  // namespace common
 
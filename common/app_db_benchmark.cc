@@ -0,0 +1,272 @@
+/*
+ * Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+
+// Measures the AppDB backends with the access patterns of the runtime.
+//
+//   app_db_benchmark [-d <directory>] [-n <iterations>]
+//
+// Each backend gets an empty directory below <directory>, a new temporary
+// directory by default, which is removed afterwards.
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "common/app_db_cache.h"
+#include "common/app_db_sqlite.h"
+#ifdef USE_APP_LOG_DB
+#include "common/app_db_log.h"
+#endif
+#include "common/picojson.h"
+
+namespace {
+
+const char* kRuntimeSection = "Runtime";
+const char* kPublicSection = "public";
+const char* kPrivateSection = "private";
+const char* kGeolocationPermissionPrefix = "__WRT_GEOPERM_";
+
+const int kPreferenceCount = 100;
+const int kPermissionCount = 200;
+const int kMigrationRowCount = 5000;
+const size_t kBundleSize = 2048;
+
+typedef std::chrono::steady_clock Clock;
+
+// The backends of the cached dbs, which do not own them.
+std::vector<std::unique_ptr<common::AppDB>> g_cached_backends;
+
+struct Backend {
+  const char* name;
+  std::function<common::AppDB*(const std::string& path)> create;
+};
+
+void RemoveTree(const std::string& path) {
+  DIR* dir = opendir(path.c_str());
+  if (dir != NULL) {
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+      std::string name = entry->d_name;
+      if (name == "." || name == "..")
+        continue;
+      RemoveTree(path + "/" + name);
+    }
+    closedir(dir);
+    rmdir(path.c_str());
+  } else {
+    unlink(path.c_str());
+  }
+}
+
+// Prints the throughput and the latency percentiles of |latencies|, in
+// microseconds.
+void Report(const std::string& backend,
+            const std::string& workload,
+            std::vector<double>* latencies,
+            size_t ops_per_sample) {
+  if (latencies->empty())
+    return;
+  std::sort(latencies->begin(), latencies->end());
+  double total = 0;
+  for (double latency : *latencies)
+    total += latency;
+  auto percentile = [latencies](double p) {
+    size_t index = static_cast<size_t>(p * (latencies->size() - 1));
+    return (*latencies)[index];
+  };
+  double ops_per_second =
+      total > 0 ? latencies->size() * ops_per_sample * 1e6 / total : 0;
+  printf("%-20s %-22s %8zu %12.0f %9.1f %9.1f %9.1f %9.1f\n",
+         backend.c_str(), workload.c_str(),
+         latencies->size() * ops_per_sample, ops_per_second,
+         percentile(0.5), percentile(0.9), percentile(0.99),
+         latencies->back());
+}
+
+double Measure(const std::function<void()>& operation) {
+  Clock::time_point start = Clock::now();
+  operation();
+  return std::chrono::duration<double, std::micro>(Clock::now() - start)
+      .count();
+}
+
+// The file wrt-upgrade writes for the apps of the old runtime.
+void WriteMigrationFile(const std::string& path) {
+  const char* sections[] = { "preference", "certificate", "security_origin" };
+  picojson::object root;
+  for (int s = 0; s < 3; ++s) {
+    picojson::array rows;
+    for (int i = s; i < kMigrationRowCount; i += 3) {
+      picojson::object row;
+      row["section"] = picojson::value(s == 0 ? kPublicSection
+                                              : kPrivateSection);
+      row["key"] = picojson::value(std::string(sections[s]) + "_" +
+                                   std::to_string(i));
+      row["value"] = picojson::value(std::string(64, 'v'));
+      rows.push_back(picojson::value(row));
+    }
+    root[sections[s]] = picojson::value(rows);
+  }
+  std::ofstream file(path);
+  file << picojson::value(root).serialize();
+}
+
+void RunBackend(const Backend& backend, const std::string& directory,
+                int iterations) {
+  // Bulk migration import, done when the db is opened.
+  std::string migration_path =
+      directory + "/" + backend.name + "-migration/";
+  mkdir(migration_path.c_str(), 0700);
+  WriteMigrationFile(migration_path + ".runtime.migration");
+  std::vector<double> latencies;
+  latencies.push_back(Measure([&] {
+    std::unique_ptr<common::AppDB> db(backend.create(migration_path));
+  }));
+  Report(backend.name, "migration import", &latencies, kMigrationRowCount);
+
+  std::string path = directory + "/" + backend.name + "/";
+  mkdir(path.c_str(), 0700);
+  std::unique_ptr<common::AppDB> db(backend.create(path));
+
+  // Widget preferences: set up once, then iterated like WidgetPreferenceDB
+  // does when it loads its cache.
+  common::AppDB::Batch batch;
+  for (int i = 0; i < kPreferenceCount; ++i) {
+    batch.Set(kPublicSection, "pref_" + std::to_string(i),
+              std::string(32, 'p'));
+  }
+  for (int i = 0; i < kPermissionCount; i += 2) {
+    batch.Set(kPrivateSection,
+              kGeolocationPermissionPrefix + std::string("https://site") +
+                  std::to_string(i) + ".example/",
+              "allowed");
+  }
+  batch.Set(kRuntimeSection, "app_id", "benchmark.App");
+  db->Apply(batch);
+  db->Flush();
+
+  latencies.clear();
+  for (int i = 0; i < iterations / 10 + 1; ++i) {
+    latencies.push_back(Measure([&] {
+      size_t visited = 0;
+      db->ForEach(kPublicSection, std::string(), 0,
+                  [&visited](const std::string&, const std::string&) {
+        ++visited;
+        return true;
+      });
+    }));
+  }
+  Report(backend.name, "preference iteration", &latencies, 1);
+
+  // Permission prompts, half of the sites were answered before.
+  latencies.clear();
+  for (int i = 0; i < iterations; ++i) {
+    std::string key = kGeolocationPermissionPrefix +
+        std::string("https://site") + std::to_string(i % kPermissionCount) +
+        ".example/";
+    latencies.push_back(Measure([&] { db->Get(kPrivateSection, key); }));
+  }
+  Report(backend.name, "permission lookup", &latencies, 1);
+
+  // Runtime variables, requested by the extensions.
+  latencies.clear();
+  for (int i = 0; i < iterations; ++i) {
+    latencies.push_back(Measure([&] { db->Get(kRuntimeSection, "app_id"); }));
+  }
+  Report(backend.name, "runtime variable read", &latencies, 1);
+
+  // The encoded bundle written on each app control.
+  latencies.clear();
+  for (int i = 0; i < iterations / 10 + 1; ++i) {
+    std::string bundle(kBundleSize, 'a' + i % 26);
+    latencies.push_back(Measure([&] {
+      db->Set(kRuntimeSection, "encoded_bundle", bundle);
+    }));
+  }
+  latencies.push_back(Measure([&] { db->Flush(); }));
+  Report(backend.name, "app control write", &latencies, 1);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  std::string directory;
+  int iterations = 10000;
+  int opt;
+  while ((opt = getopt(argc, argv, "d:n:")) != -1) {
+    switch (opt) {
+      case 'd':
+        directory = optarg;
+        break;
+      case 'n':
+        iterations = std::max(1, atoi(optarg));
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [-d directory] [-n iterations]\n",
+                argv[0]);
+        return 1;
+    }
+  }
+  bool remove_directory = false;
+  if (directory.empty()) {
+    char temp[] = "/tmp/app_db_benchmark.XXXXXX";
+    if (mkdtemp(temp) == NULL) {
+      perror("mkdtemp");
+      return 1;
+    }
+    directory = temp;
+    remove_directory = true;
+  }
+
+  std::vector<Backend> backends = {
+    { "sqlite", [](const std::string& path) -> common::AppDB* {
+      return new common::SqliteDB(path);
+    } },
+    { "sqlite-write-behind", [](const std::string& path) -> common::AppDB* {
+      return new common::SqliteDB(path, true);
+    } },
+    { "sqlite-cached", [](const std::string& path) -> common::AppDB* {
+      g_cached_backends.emplace_back(new common::SqliteDB(path));
+      return new common::CachedAppDB(g_cached_backends.back().get());
+    } },
+#ifdef USE_APP_LOG_DB
+    { "log", [](const std::string& path) -> common::AppDB* {
+      return new common::LogAppDB(path);
+    } },
+#endif
+  };
+
+  printf("%-20s %-22s %8s %12s %9s %9s %9s %9s\n", "backend", "workload",
+         "ops", "ops/sec", "p50(us)", "p90(us)", "p99(us)", "max(us)");
+  for (const auto& backend : backends)
+    RunBackend(backend, directory, iterations);
+
+  g_cached_backends.clear();
+  if (remove_directory)
+    RemoveTree(directory);
+  return 0;
+}
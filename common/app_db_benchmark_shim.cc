@@ -0,0 +1,36 @@
+/*
+ * Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+
+// Logging for app_db_benchmark, which does not link dlog: the warnings and
+// the errors of the AppDB backends are written to stderr.
+
+#include <dlog.h>
+#include <stdarg.h>
+#include <stdio.h>
+
+int __dlog_print(log_id_t /*log_id*/, int prio, const char* tag,
+                 const char* fmt, ...) {
+  if (prio < DLOG_WARN)
+    return 0;
+  va_list args;
+  va_start(args, fmt);
+  fprintf(stderr, "%s: ", tag);
+  int written = vfprintf(stderr, fmt, args);
+  fputc('\n', stderr);
+  va_end(args);
+  return written;
+}
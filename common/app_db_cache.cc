@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+
+#include "common/app_db_cache.h"
+
+namespace common {
+
+CachedAppDB::CachedAppDB(AppDB* db)
+    : db_(db),
+      change_counter_(db->GetChangeCounter()) {
+}
+
+CachedAppDB::~CachedAppDB() {
+}
+
+const CachedAppDB::Section* CachedAppDB::GetSection(
+    const std::string& section) const {
+  // The counter is read before the section is loaded, so a write racing
+  // with the load drops the section again on the next read.
+  unsigned change_counter = db_->GetChangeCounter();
+  if (change_counter != change_counter_) {
+    sections_.clear();
+    change_counter_ = change_counter;
+  }
+
+  auto it = sections_.find(section);
+  if (it != sections_.end())
+    return &it->second;
+
+  Section loaded;
+  if (!db_->ForEach(section, std::string(), 0,
+                    [&loaded](const std::string& key,
+                              const std::string& value) {
+    loaded.keys.push_back(key);
+    loaded.values[key] = value;
+    return true;
+  }))
+    return NULL;
+  Section& cached = sections_[section];
+  cached.keys.swap(loaded.keys);
+  cached.values.swap(loaded.values);
+  return &cached;
+}
+
+// A write of this object moves the counter by one, so only the sections it
+// wrote are dropped. Any other move of the counter is a write from
+// elsewhere, and the next read drops all the sections.
+void CachedAppDB::Write(const std::set<std::string>& sections,
+                        const std::function<void()>& write) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  unsigned before = db_->GetChangeCounter();
+  write();
+  unsigned after = db_->GetChangeCounter();
+  for (const auto& section : sections)
+    sections_.erase(section);
+  if (before == change_counter_ && after == before + 1)
+    change_counter_ = after;
+}
+
+bool CachedAppDB::HasKey(const std::string& section,
+                         const std::string& key) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const Section* cached = GetSection(section);
+  if (cached == NULL)
+    return db_->HasKey(section, key);
+  return cached->values.find(key) != cached->values.end();
+}
+
+std::string CachedAppDB::Get(const std::string& section,
+                             const std::string& key) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const Section* cached = GetSection(section);
+  if (cached == NULL)
+    return db_->Get(section, key);
+  auto it = cached->values.find(key);
+  if (it == cached->values.end())
+    return std::string();
+  return it->second;
+}
+
+void CachedAppDB::Set(const std::string& section,
+                      const std::string& key,
+                      const std::string& value) {
+  Write({section}, [&] { db_->Set(section, key, value); });
+}
+
+void CachedAppDB::GetKeys(const std::string& section,
+                          std::list<std::string>* keys) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const Section* cached = GetSection(section);
+  if (cached == NULL) {
+    db_->GetKeys(section, keys);
+    return;
+  }
+  keys->insert(keys->end(), cached->keys.begin(), cached->keys.end());
+}
+
+bool CachedAppDB::ForEach(const std::string& section,
+                          const std::string& prefix,
+                          size_t limit,
+                          const Visitor& visitor) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const Section* cached = GetSection(section);
+  if (cached == NULL)
+    return db_->ForEach(section, prefix, limit, visitor);
+  size_t count = 0;
+  for (const auto& key : cached->keys) {
+    if (limit != 0 && count >= limit)
+      break;
+    if (key.compare(0, prefix.size(), prefix) != 0)
+      continue;
+    auto it = cached->values.find(key);
+    if (it == cached->values.end())
+      continue;
+    ++count;
+    if (!visitor(key, it->second))
+      break;
+  }
+  return true;
+}
+
+void CachedAppDB::GetValues(const std::string& section,
+                            const std::list<std::string>& keys,
+                            std::map<std::string, std::string>* values) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const Section* cached = GetSection(section);
+  if (cached == NULL) {
+    db_->GetValues(section, keys, values);
+    return;
+  }
+  for (const auto& key : keys) {
+    auto it = cached->values.find(key);
+    if (it != cached->values.end())
+      (*values)[key] = it->second;
+  }
+}
+
+void CachedAppDB::SetValues(const std::string& section,
+                            const std::map<std::string, std::string>& values) {
+  Write({section}, [&] { db_->SetValues(section, values); });
+}
+
+void CachedAppDB::Remove(const std::string& section,
+                         const std::string& key) {
+  Write({section}, [&] { db_->Remove(section, key); });
+}
+
+bool CachedAppDB::Apply(const Batch& batch) {
+  std::set<std::string> sections;
+  for (const auto& op : batch.operations())
+    sections.insert(op.section);
+  bool result = false;
+  Write(sections, [&] { result = db_->Apply(batch); });
+  return result;
+}
+
+void CachedAppDB::Flush() {
+  db_->Flush();
+}
+
+void CachedAppDB::Shutdown() {
+  db_->Shutdown();
+}
+
+unsigned CachedAppDB::GetChangeCounter() const {
+  return db_->GetChangeCounter();
+}
+
+}  // namespace common
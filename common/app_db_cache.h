@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#ifndef XWALK_COMMON_APP_DB_CACHE_H_
+#define XWALK_COMMON_APP_DB_CACHE_H_
+
+#include <functional>
+#include <list>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "common/app_db.h"
+
+namespace common {
+
+// Keeps the sections read from |db| in memory, so repeated reads do not
+// query the backend. A section is loaded whole on its first read and
+// dropped when it is written through this object. All sections are dropped
+// when the change counter of the backend shows a write from elsewhere.
+class CachedAppDB : public AppDB {
+ public:
+  explicit CachedAppDB(AppDB* db);
+  ~CachedAppDB();
+  virtual bool HasKey(const std::string& section,
+                      const std::string& key) const;
+  virtual std::string Get(const std::string& section,
+                          const std::string& key) const;
+  virtual void Set(const std::string& section,
+                   const std::string& key,
+                   const std::string& value);
+  virtual void GetKeys(const std::string& section,
+                       std::list<std::string>* keys) const;
+  virtual bool ForEach(const std::string& section,
+                       const std::string& prefix,
+                       size_t limit,
+                       const Visitor& visitor) const;
+  virtual void GetValues(const std::string& section,
+                         const std::list<std::string>& keys,
+                         std::map<std::string, std::string>* values) const;
+  virtual void SetValues(const std::string& section,
+                         const std::map<std::string, std::string>& values);
+  virtual void Remove(const std::string& section,
+                      const std::string& key);
+  virtual bool Apply(const Batch& batch);
+  virtual void Flush();
+  virtual void Shutdown();
+  virtual unsigned GetChangeCounter() const;
+
+ private:
+  struct Section {
+    std::vector<std::string> keys;
+    std::unordered_map<std::string, std::string> values;
+  };
+
+  // Returns the cached |section|, loading it if needed, or NULL if it could
+  // not be read. The reads then go to the backend. |mutex_| must be held.
+  const Section* GetSection(const std::string& section) const;
+  // Runs |write| on the backend, and drops the cached |sections| it changes.
+  void Write(const std::set<std::string>& sections,
+             const std::function<void()>& write);
+
+  AppDB* db_;
+  mutable std::mutex mutex_;
+  mutable std::unordered_map<std::string, Section> sections_;
+  mutable unsigned change_counter_;
+};
+
+}  // namespace common
+
+#endif  // XWALK_COMMON_APP_DB_CACHE_H_
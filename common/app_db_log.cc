@@ -0,0 +1,666 @@
+/*
+ * Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+
+#include "common/app_db_log.h"
+
+#include <app.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <set>
+
+#include "common/app_db_sqlite.h"
+#include "common/file_utils.h"
+#include "common/logger.h"
+
+namespace common {
+
+namespace {
+
+const char kLogMagic[8] = { 'X', 'W', 'A', 'P', 'P', 'D', 'B', '1' };
+const char* kLogFileName = "/.appdb.log";
+const char* kLockFileName = "/.appdb.log.lock";
+const char* kTempFileSuffix = ".tmp";
+// The files of SqliteDB, which are moved to the log on the first open.
+const char* kSqliteFileNames[] = {
+  "/.appdb.db", "/.appdb.db-wal", "/.appdb.db-shm", "/.appdb.counter"
+};
+const char* kMigrationFileName = ".runtime.migration";
+
+// The log is compacted when it grows past this size and is mostly
+// overwritten data.
+const size_t kMinCompactionSize = 64 * 1024;
+
+enum RecordType {
+  kSetRecord = 1,
+  kRemoveRecord = 2,
+  // The value holds the kept keys.
+  kRemoveSectionRecord = 3
+};
+
+struct FrameHeader {
+  uint32_t length;
+  uint32_t checksum;
+};
+
+// A record is its type, the lengths of the section, key and value, and
+// their bytes.
+const size_t kRecordHeaderSize = 1 + 3 * sizeof(uint32_t);
+
+uint32_t Checksum(const char* data, size_t length) {
+  static const std::vector<uint32_t> table = [] {
+    std::vector<uint32_t> crc_table(256);
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t crc = i;
+      for (int bit = 0; bit < 8; ++bit)
+        crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+      crc_table[i] = crc;
+    }
+    return crc_table;
+  }();
+  uint32_t crc = 0xFFFFFFFFu;
+  for (size_t i = 0; i < length; ++i)
+    crc = table[(crc ^ static_cast<uint8_t>(data[i])) & 0xFF] ^ (crc >> 8);
+  return crc ^ 0xFFFFFFFFu;
+}
+
+size_t RecordSize(const std::string& section,
+                  const std::string& key,
+                  const std::string& value) {
+  return kRecordHeaderSize + section.size() + key.size() + value.size();
+}
+
+void AppendLength(std::string* out, size_t length) {
+  uint32_t value = length;
+  out->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void AppendRecord(std::string* out,
+                  RecordType type,
+                  const std::string& section,
+                  const std::string& key,
+                  const std::string& value) {
+  out->push_back(static_cast<char>(type));
+  AppendLength(out, section.size());
+  AppendLength(out, key.size());
+  AppendLength(out, value.size());
+  out->append(section);
+  out->append(key);
+  out->append(value);
+}
+
+std::string EncodeKeys(const std::set<std::string>& keys) {
+  std::string encoded;
+  for (const auto& key : keys) {
+    AppendLength(&encoded, key.size());
+    encoded.append(key);
+  }
+  return encoded;
+}
+
+void DecodeKeys(const std::string& encoded, std::set<std::string>* keys) {
+  size_t offset = 0;
+  while (offset + sizeof(uint32_t) <= encoded.size()) {
+    uint32_t length;
+    memcpy(&length, encoded.data() + offset, sizeof(length));
+    offset += sizeof(length);
+    if (length > encoded.size() - offset)
+      break;
+    keys->insert(encoded.substr(offset, length));
+    offset += length;
+  }
+}
+
+bool WriteAll(int fd, const std::string& data, off_t offset) {
+  size_t written = 0;
+  while (written < data.size()) {
+    ssize_t ret = pwrite(fd, data.data() + written, data.size() - written,
+                         offset + written);
+    if (ret < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    written += ret;
+  }
+  return true;
+}
+
+bool ReadAll(int fd, std::string* data, off_t offset) {
+  size_t read_size = 0;
+  while (read_size < data->size()) {
+    ssize_t ret = pread(fd, &(*data)[read_size], data->size() - read_size,
+                        offset + read_size);
+    if (ret < 0 && errno == EINTR)
+      continue;
+    if (ret <= 0)
+      return false;
+    read_size += ret;
+  }
+  return true;
+}
+
+std::string EncodeFrame(const std::string& payload) {
+  FrameHeader header = { static_cast<uint32_t>(payload.size()),
+                         Checksum(payload.data(), payload.size()) };
+  std::string frame(reinterpret_cast<const char*>(&header), sizeof(header));
+  frame.append(payload);
+  return frame;
+}
+
+// Serializes the writers of all the processes of the app. A file lock on
+// the log itself would not survive the rename done by compaction.
+class ScopedFileLock {
+ public:
+  explicit ScopedFileLock(int fd) : fd_(fd) {
+    while (fd_ >= 0 && flock(fd_, LOCK_EX) != 0 && errno == EINTR) {}
+  }
+  ~ScopedFileLock() {
+    if (fd_ >= 0)
+      flock(fd_, LOCK_UN);
+  }
+ private:
+  int fd_;
+};
+
+}  // namespace
+
+// Mapped shared by all the processes which use the log.
+struct LogAppDB::Header {
+  char magic[8];
+  // Where the frames written so far end. Only a hint for the other
+  // processes, the frames are checked again when the log is opened.
+  uint64_t committed_size;
+  uint32_t change_count;
+  // Set when compaction replaced the file, which then has to be reopened.
+  uint32_t replaced;
+};
+
+LogAppDB::LogAppDB(const std::string& app_data_path)
+    : app_data_path_(app_data_path),
+      lock_fd_(-1),
+      fd_(-1),
+      header_(NULL),
+      indexed_size_(0),
+      live_size_(0) {
+  if (app_data_path_.empty()) {
+    std::unique_ptr<char, decltype(std::free)*>
+    path {app_get_data_path(), std::free};
+    if (path.get() != NULL)
+      app_data_path_ = path.get();
+  }
+  Initialize();
+}
+
+LogAppDB::~LogAppDB() {
+  Close();
+  if (lock_fd_ >= 0)
+    close(lock_fd_);
+}
+
+void LogAppDB::Initialize() {
+  if (app_data_path_.empty()) {
+    LOGGER(ERROR) << "app data path was empty";
+    return;
+  }
+  log_path_ = app_data_path_ + kLogFileName;
+  std::string lock_path = app_data_path_ + kLockFileName;
+  lock_fd_ = open(lock_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (lock_fd_ < 0) {
+    LOGGER(ERROR) << "Fail to open app db lock : " << strerror(errno);
+    return;
+  }
+
+  std::lock_guard<std::mutex> guard(mutex_);
+  ScopedFileLock lock(lock_fd_);
+  if (!Open())
+    return;
+  MigrateFromSqlite();
+}
+
+bool LogAppDB::Open() const {
+  fd_ = open(log_path_.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (fd_ < 0) {
+    LOGGER(ERROR) << "Fail to open app db : " << strerror(errno);
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd_, &st) != 0) {
+    LOGGER(ERROR) << "Fail to stat app db : " << strerror(errno);
+    Close();
+    return false;
+  }
+  size_t size = st.st_size;
+  if (size < sizeof(Header)) {
+    Header header;
+    memcpy(header.magic, kLogMagic, sizeof(header.magic));
+    header.committed_size = sizeof(Header);
+    header.change_count = 0;
+    header.replaced = 0;
+    std::string data(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (!WriteAll(fd_, data, 0) || ftruncate(fd_, sizeof(header)) != 0) {
+      LOGGER(ERROR) << "Fail to create app db : " << strerror(errno);
+      Close();
+      return false;
+    }
+    fdatasync(fd_);
+    size = sizeof(header);
+  }
+
+  void* data = mmap(NULL, size, PROT_READ, MAP_SHARED, fd_, 0);
+  if (data == MAP_FAILED) {
+    LOGGER(ERROR) << "Fail to map app db : " << strerror(errno);
+    Close();
+    return false;
+  }
+  const char* bytes = static_cast<const char*>(data);
+  if (memcmp(bytes, kLogMagic, sizeof(kLogMagic)) != 0) {
+    LOGGER(ERROR) << "App db is not a log : " << log_path_;
+    munmap(data, size);
+    Close();
+    return false;
+  }
+  sections_.clear();
+  live_size_ = 0;
+  size_t valid_size = Replay(bytes, sizeof(Header), size);
+  munmap(data, size);
+
+  if (valid_size < size) {
+    LOGGER(WARN) << "Drop " << size - valid_size
+                 << " bytes of an interrupted app db write";
+    if (ftruncate(fd_, valid_size) != 0)
+      LOGGER(ERROR) << "Fail to truncate app db : " << strerror(errno);
+  }
+
+  void* header = mmap(NULL, sizeof(Header), PROT_READ | PROT_WRITE,
+                      MAP_SHARED, fd_, 0);
+  if (header == MAP_FAILED) {
+    LOGGER(ERROR) << "Fail to map app db header : " << strerror(errno);
+    Close();
+    return false;
+  }
+  header_ = static_cast<Header*>(header);
+  indexed_size_ = valid_size;
+  __atomic_store_n(&header_->committed_size, valid_size, __ATOMIC_RELEASE);
+  return true;
+}
+
+void LogAppDB::Close() const {
+  if (header_ != NULL) {
+    munmap(header_, sizeof(Header));
+    header_ = NULL;
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+    fd_ = -1;
+  }
+}
+
+size_t LogAppDB::Replay(const char* data, size_t begin, size_t end) const {
+  size_t offset = begin;
+  while (offset + sizeof(FrameHeader) <= end) {
+    FrameHeader header;
+    memcpy(&header, data + offset, sizeof(header));
+    const char* payload = data + offset + sizeof(header);
+    if (header.length == 0 ||
+        header.length > end - offset - sizeof(header) ||
+        Checksum(payload, header.length) != header.checksum)
+      break;
+    ApplyRecords(payload, header.length);
+    offset += sizeof(header) + header.length;
+  }
+  return offset;
+}
+
+void LogAppDB::ApplyRecords(const char* data, size_t length) const {
+  size_t offset = 0;
+  while (offset + kRecordHeaderSize <= length) {
+    uint8_t type = data[offset];
+    uint32_t lengths[3];
+    memcpy(lengths, data + offset + 1, sizeof(lengths));
+    offset += kRecordHeaderSize;
+    if (static_cast<uint64_t>(lengths[0]) + lengths[1] + lengths[2] >
+        length - offset) {
+      LOGGER(ERROR) << "Malformed app db record";
+      return;
+    }
+    std::string section(data + offset, lengths[0]);
+    std::string key(data + offset + lengths[0], lengths[1]);
+    std::string value(data + offset + lengths[0] + lengths[1], lengths[2]);
+    offset += lengths[0] + lengths[1] + lengths[2];
+
+    Section& values = sections_[section];
+    switch (type) {
+      case kSetRecord: {
+        auto it = values.find(key);
+        if (it != values.end())
+          live_size_ -= RecordSize(section, key, it->second);
+        live_size_ += RecordSize(section, key, value);
+        values[key] = value;
+        break;
+      }
+      case kRemoveRecord: {
+        auto it = values.find(key);
+        if (it != values.end()) {
+          live_size_ -= RecordSize(section, key, it->second);
+          values.erase(it);
+        }
+        break;
+      }
+      case kRemoveSectionRecord: {
+        std::set<std::string> kept_keys;
+        DecodeKeys(value, &kept_keys);
+        for (auto it = values.begin(); it != values.end(); ) {
+          if (kept_keys.find(it->first) != kept_keys.end()) {
+            ++it;
+            continue;
+          }
+          live_size_ -= RecordSize(section, it->first, it->second);
+          it = values.erase(it);
+        }
+        break;
+      }
+      default:
+        LOGGER(ERROR) << "Unknown app db record : " << static_cast<int>(type);
+        break;
+    }
+    if (values.empty())
+      sections_.erase(section);
+  }
+}
+
+bool LogAppDB::CatchUp(bool locked) const {
+  if (header_ == NULL)
+    return false;
+  if (__atomic_load_n(&header_->replaced, __ATOMIC_ACQUIRE)) {
+    ScopedFileLock lock(locked ? -1 : lock_fd_);
+    Close();
+    return Open();
+  }
+
+  size_t committed_size =
+      __atomic_load_n(&header_->committed_size, __ATOMIC_ACQUIRE);
+  if (committed_size <= indexed_size_)
+    return true;
+  std::string data(committed_size - indexed_size_, '\0');
+  if (!ReadAll(fd_, &data, indexed_size_)) {
+    LOGGER(ERROR) << "Fail to read app db : " << strerror(errno);
+    return false;
+  }
+  indexed_size_ += Replay(data.data(), 0, data.size());
+  return true;
+}
+
+bool LogAppDB::Write(const std::vector<Batch::Operation>& operations) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  ScopedFileLock lock(lock_fd_);
+  return WriteLocked(operations);
+}
+
+bool LogAppDB::WriteLocked(const std::vector<Batch::Operation>& operations) {
+  CatchUp(true);
+  if (header_ == NULL) {
+    LOGGER(ERROR) << "App db was not initialized";
+    return false;
+  }
+
+  std::string payload;
+  for (const auto& op : operations) {
+    switch (op.type) {
+      case Batch::kSet:
+        AppendRecord(&payload, kSetRecord, op.section, op.key, op.value);
+        break;
+      case Batch::kRemove:
+        AppendRecord(&payload, kRemoveRecord, op.section, op.key,
+                     std::string());
+        break;
+      case Batch::kRemoveSection:
+        AppendRecord(&payload, kRemoveSectionRecord, op.section,
+                     std::string(), EncodeKeys(op.kept_keys));
+        break;
+    }
+  }
+  if (payload.empty())
+    return true;
+
+  // The frame is synced before it is published in the header, so the other
+  // processes never read a partial frame.
+  std::string frame = EncodeFrame(payload);
+  if (!WriteAll(fd_, frame, indexed_size_)) {
+    LOGGER(ERROR) << "Fail to write app db : " << strerror(errno);
+    return false;
+  }
+  if (fdatasync(fd_) != 0)
+    LOGGER(ERROR) << "Fail to sync app db : " << strerror(errno);
+  ApplyRecords(payload.data(), payload.size());
+  indexed_size_ += frame.size();
+  __atomic_store_n(&header_->committed_size, indexed_size_, __ATOMIC_RELEASE);
+  __atomic_add_fetch(&header_->change_count, 1, __ATOMIC_SEQ_CST);
+
+  if (indexed_size_ > kMinCompactionSize &&
+      indexed_size_ > 2 * (live_size_ + sizeof(Header)))
+    Rewrite();
+  return true;
+}
+
+bool LogAppDB::Rewrite() {
+  std::string payload;
+  for (const auto& section : sections_) {
+    for (const auto& value : section.second) {
+      AppendRecord(&payload, kSetRecord, section.first, value.first,
+                   value.second);
+    }
+  }
+
+  Header header;
+  memcpy(header.magic, kLogMagic, sizeof(header.magic));
+  header.change_count = header_->change_count + 1;
+  header.replaced = 0;
+  std::string data;
+  if (!payload.empty())
+    data = EncodeFrame(payload);
+  header.committed_size = sizeof(header) + data.size();
+  data.insert(0, reinterpret_cast<const char*>(&header), sizeof(header));
+
+  std::string temp_path = log_path_ + kTempFileSuffix;
+  int fd = open(temp_path.c_str(),
+                O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    LOGGER(ERROR) << "Fail to create app db : " << strerror(errno);
+    return false;
+  }
+  bool written = WriteAll(fd, data, 0) && fdatasync(fd) == 0;
+  close(fd);
+  if (!written || rename(temp_path.c_str(), log_path_.c_str()) != 0) {
+    LOGGER(ERROR) << "Fail to compact app db : " << strerror(errno);
+    unlink(temp_path.c_str());
+    return false;
+  }
+  int dir_fd = open(app_data_path_.c_str(), O_RDONLY | O_DIRECTORY);
+  if (dir_fd >= 0) {
+    fsync(dir_fd);
+    close(dir_fd);
+  }
+
+  LOGGER(DEBUG) << "App db compacted from " << indexed_size_ << " to "
+                << data.size() << " bytes";
+  __atomic_store_n(&header_->replaced, 1, __ATOMIC_RELEASE);
+  Close();
+  return Open();
+}
+
+// SqliteDB also imports the migration file of wrt-upgrade, so it is used
+// for that file too.
+void LogAppDB::MigrateFromSqlite() {
+  bool has_sqlite_db = utils::Exists(app_data_path_ + kSqliteFileNames[0]);
+  if (!has_sqlite_db &&
+      !utils::Exists(app_data_path_ + kMigrationFileName))
+    return;
+
+  // The sqlite db is only removed once all its rows are in the log, or it
+  // is moved again on the next launch.
+  Batch batch;
+  bool read;
+  {
+    SqliteDB sqlite_db(app_data_path_);
+    read = sqlite_db.ForEachRow([&batch](const std::string& section,
+                                         const std::string& key,
+                                         const std::string& value) {
+      batch.Set(section, key, value);
+    });
+  }
+  if (!read || !WriteLocked(batch.operations())) {
+    LOGGER(ERROR) << "Fail to move the app db to the log";
+    return;
+  }
+  LOGGER(DEBUG) << "Moved " << batch.operations().size()
+                << " values to the app db log";
+  for (const char* file_name : kSqliteFileNames)
+    unlink((app_data_path_ + file_name).c_str());
+}
+
+bool LogAppDB::HasKey(const std::string& section,
+                      const std::string& key) const {
+  std::lock_guard<std::mutex> guard(mutex_);
+  CatchUp(false);
+  auto it = sections_.find(section);
+  return it != sections_.end() && it->second.find(key) != it->second.end();
+}
+
+std::string LogAppDB::Get(const std::string& section,
+                          const std::string& key) const {
+  std::lock_guard<std::mutex> guard(mutex_);
+  CatchUp(false);
+  auto it = sections_.find(section);
+  if (it == sections_.end())
+    return std::string();
+  auto value = it->second.find(key);
+  if (value == it->second.end())
+    return std::string();
+  return value->second;
+}
+
+void LogAppDB::Set(const std::string& section,
+                   const std::string& key,
+                   const std::string& value) {
+  Batch batch;
+  batch.Set(section, key, value);
+  Write(batch.operations());
+}
+
+void LogAppDB::GetKeys(const std::string& section,
+                       std::list<std::string>* keys) const {
+  ForEach(section, std::string(), 0,
+          [keys](const std::string& key, const std::string&) {
+    keys->push_back(key);
+    return true;
+  });
+}
+
+// The index is not ordered, so the matching keys are sorted to visit them
+// in key order like the other backends.
+bool LogAppDB::ForEach(const std::string& section,
+                       const std::string& prefix,
+                       size_t limit,
+                       const Visitor& visitor) const {
+  std::lock_guard<std::mutex> guard(mutex_);
+  if (!CatchUp(false))
+    return false;
+  auto it = sections_.find(section);
+  if (it == sections_.end())
+    return true;
+
+  std::vector<const Section::value_type*> entries;
+  for (const auto& entry : it->second) {
+    if (entry.first.compare(0, prefix.size(), prefix) == 0)
+      entries.push_back(&entry);
+  }
+  std::sort(entries.begin(), entries.end(),
+            [](const Section::value_type* a, const Section::value_type* b) {
+    return a->first < b->first;
+  });
+  if (limit != 0 && entries.size() > limit)
+    entries.resize(limit);
+  for (const auto* entry : entries) {
+    if (!visitor(entry->first, entry->second))
+      break;
+  }
+  return true;
+}
+
+void LogAppDB::GetValues(const std::string& section,
+                         const std::list<std::string>& keys,
+                         std::map<std::string, std::string>* values) const {
+  std::lock_guard<std::mutex> guard(mutex_);
+  CatchUp(false);
+  auto it = sections_.find(section);
+  if (it == sections_.end())
+    return;
+  for (const auto& key : keys) {
+    auto value = it->second.find(key);
+    if (value != it->second.end())
+      (*values)[key] = value->second;
+  }
+}
+
+void LogAppDB::SetValues(const std::string& section,
+                         const std::map<std::string, std::string>& values) {
+  Batch batch;
+  for (const auto& value : values)
+    batch.Set(section, value.first, value.second);
+  Write(batch.operations());
+}
+
+void LogAppDB::Remove(const std::string& section,
+                      const std::string& key) {
+  Batch batch;
+  batch.Remove(section, key);
+  Write(batch.operations());
+}
+
+bool LogAppDB::Apply(const Batch& batch) {
+  return Write(batch.operations());
+}
+
+// Writes are synced before they return.
+void LogAppDB::Flush() {
+}
+
+void LogAppDB::Shutdown() {
+}
+
+unsigned LogAppDB::GetChangeCounter() const {
+  std::lock_guard<std::mutex> guard(mutex_);
+  CatchUp(false);
+  if (header_ == NULL) {
+    static std::atomic<unsigned> counter(0);
+    return ++counter;
+  }
+  return __atomic_load_n(&header_->change_count, __ATOMIC_ACQUIRE);
+}
+
+}  // namespace common
@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+
+#ifndef XWALK_COMMON_APP_DB_LOG_H_
+#define XWALK_COMMON_APP_DB_LOG_H_
+
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "common/app_db.h"
+
+namespace common {
+
+// Keeps the whole db in memory and appends the changes to a log file,
+// ".appdb.log" in the app data directory. The log is read back through a
+// read-only mapping when it is opened, and compacted when most of it is
+// overwritten data.
+//
+// The log is a header followed by frames, each being the changes of one
+// write. A frame carries a checksum, so a frame torn by a crash is dropped
+// whole on the next open. The header is mapped shared by all the processes
+// of the app, and tells them how much of the log was committed, so they
+// read the changes of the others before using their own index.
+class LogAppDB : public AppDB {
+ public:
+  explicit LogAppDB(const std::string& app_data_path = std::string());
+  ~LogAppDB();
+  virtual bool HasKey(const std::string& section,
+                      const std::string& key) const;
+  virtual std::string Get(const std::string& section,
+                          const std::string& key) const;
+  virtual void Set(const std::string& section,
+                   const std::string& key,
+                   const std::string& value);
+  virtual void GetKeys(const std::string& section,
+                       std::list<std::string>* keys) const;
+  virtual bool ForEach(const std::string& section,
+                       const std::string& prefix,
+                       size_t limit,
+                       const Visitor& visitor) const;
+  virtual void GetValues(const std::string& section,
+                         const std::list<std::string>& keys,
+                         std::map<std::string, std::string>* values) const;
+  virtual void SetValues(const std::string& section,
+                         const std::map<std::string, std::string>& values);
+  virtual void Remove(const std::string& section,
+                      const std::string& key);
+  virtual bool Apply(const Batch& batch);
+  virtual void Flush();
+  virtual void Shutdown();
+  virtual unsigned GetChangeCounter() const;
+
+ private:
+  struct Header;
+  typedef std::unordered_map<std::string, std::string> Section;
+
+  void Initialize();
+  // The caller holds the file lock.
+  bool Open() const;
+  void Close() const;
+  // Reads the frames committed by the other processes. |mutex_| is held,
+  // and |locked| tells whether the file lock is held too. Returns false if
+  // the index could not be brought up to date.
+  bool CatchUp(bool locked) const;
+  // Applies the frames in [|begin|, |end|) of |data| to the index, and
+  // returns where the valid frames end.
+  size_t Replay(const char* data, size_t begin, size_t end) const;
+  void ApplyRecords(const char* data, size_t length) const;
+  bool Write(const std::vector<Batch::Operation>& operations);
+  // The caller holds |mutex_| and the file lock.
+  bool WriteLocked(const std::vector<Batch::Operation>& operations);
+  // Writes the live data to a new log which replaces the current one. The
+  // caller holds the file lock.
+  bool Rewrite();
+  void MigrateFromSqlite();
+
+  std::string app_data_path_;
+  std::string log_path_;
+  int lock_fd_;
+  mutable int fd_;
+  mutable Header* header_;
+  mutable size_t indexed_size_;
+  mutable size_t live_size_;
+  mutable std::unordered_map<std::string, Section> sections_;
+  mutable std::mutex mutex_;
+};
+
+}  // namespace common
+
+#endif  // XWALK_COMMON_APP_DB_LOG_H_
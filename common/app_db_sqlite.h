@@ -17,17 +17,30 @@
 #ifndef XWALK_COMMON_APP_DB_SQLITE_H_
 #define XWALK_COMMON_APP_DB_SQLITE_H_
 
+#include <atomic>
+#include <condition_variable>
+#include <functional>
 #include <list>
+#include <map>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include "common/app_db.h"
 
 class sqlite3;
+class sqlite3_stmt;
 
 namespace common {
 class SqliteDB : public AppDB {
  public:
-  explicit SqliteDB(const std::string& app_data_path = std::string());
+  // With |write_behind|, Set() and Remove() return at once and a background
+  // thread writes the changes. Reads still see them before they are written.
+  // Apply() always writes before it returns, as it reports the result.
+  explicit SqliteDB(const std::string& app_data_path = std::string(),
+                    bool write_behind = false);
   ~SqliteDB();
   virtual bool HasKey(const std::string& section,
                       const std::string& key) const;
@@ -38,14 +51,105 @@ class SqliteDB : public AppDB {
                    const std::string& value);
   virtual void GetKeys(const std::string& section,
                        std::list<std::string>* keys) const;
+  virtual bool ForEach(const std::string& section,
+                       const std::string& prefix,
+                       size_t limit,
+                       const Visitor& visitor) const;
+  virtual void GetValues(const std::string& section,
+                         const std::list<std::string>& keys,
+                         std::map<std::string, std::string>* values) const;
+  virtual void SetValues(const std::string& section,
+                         const std::map<std::string, std::string>& values);
   virtual void Remove(const std::string& section,
                       const std::string& key);
+  virtual bool Apply(const Batch& batch);
+  virtual void Flush();
+  virtual void Shutdown();
+  virtual unsigned GetChangeCounter() const;
+
+  // Visits every row of the db, to move it to another backend. Returns false
+  // if the rows could not all be read.
+  bool ForEachRow(const std::function<void(const std::string& section,
+                                           const std::string& key,
+                                           const std::string& value)>&
+                      callback);
 
  private:
+  // The statements are prepared once in Initialize() and reset after each
+  // use, so the queries are parsed once per connection.
+  enum StatementType {
+    kHasKeyStatement,
+    kGetStatement,
+    kSetStatement,
+    kRemoveStatement,
+    kGetKeysStatement,
+    kForEachStatement,
+    kStatementCount
+  };
+
+  typedef std::pair<std::string, std::string> SectionKey;
+  // The latest queued change of a key which is not written yet.
+  struct PendingWrite {
+    bool removed;
+    std::string value;
+    unsigned sequence;
+  };
+
   void Initialize();
   void MigrationAppdb();
+  bool PrepareStatements();
+  sqlite3_stmt* GetStatement(StatementType type) const;
+  void OpenChangeCounter();
+  void NotifyChanged();
+  bool Execute(const char* query);
+  bool ApplyOperation(const Batch::Operation& operation);
+  // Sets |busy| when the operations failed because the db was locked.
+  bool ApplyOperations(const std::vector<Batch::Operation>& operations,
+                       bool* busy);
+  bool IsBusy() const;
+  void LogBusy(const char* operation) const;
+  bool Write(const std::vector<Batch::Operation>& operations);
+  void GetKeysLocked(const std::string& section,
+                     std::list<std::string>* keys) const;
+  void StartWriter();
+  // |lock| holds |pending_mutex_|.
+  void FlushLocked(std::unique_lock<std::mutex>* lock);
+  void EnqueueLocked(const std::vector<Batch::Operation>& operations);
+  void WriterMain();
+
   std::string app_data_path_;
   sqlite3* sqldb_;
+  sqlite3_stmt* statements_[kStatementCount];
+  // Guards |sqldb_| and |statements_|, which the writer thread also uses.
+  mutable std::mutex db_mutex_;
+  // Shared with the other processes of the app through a mapped file.
+  unsigned* change_counter_;
+
+  bool write_behind_;
+  // Started with |write_behind_|, or when a write finds the db busy.
+  std::thread writer_;
+  // Guards the members below. Taken before |db_mutex_| when both are held.
+  mutable std::mutex pending_mutex_;
+  std::condition_variable pending_cond_;
+  std::condition_variable flushed_cond_;
+  std::vector<Batch::Operation> pending_operations_;
+  std::map<SectionKey, PendingWrite> pending_writes_;
+  unsigned last_sequence_;
+  unsigned written_sequence_;
+  bool stopping_;
+  // Set when the writer gave up on a busy db until the next write or Flush().
+  bool writer_stalled_;
+
+  // Set while a read or an Apply() runs, it waits a little for a busy db.
+  // Guarded by |db_mutex_|.
+  mutable bool wait_on_busy_;
+  // Number of Flush() calls waiting for the writer. Guarded by
+  // |pending_mutex_|.
+  unsigned flush_waiters_;
+
+  // Contention counters, logged when the db is busy.
+  std::atomic<unsigned> busy_count_;
+  std::atomic<unsigned> deferred_count_;
 };
 
 }  //  namespace common
@@ -24,6 +24,8 @@
         'app_db.h',
         'app_db.cc',
         'app_db_sqlite.h',
+        'app_db_cache.h',
+        'app_db_cache.cc',
         'application_data.h',
         'application_data.cc',
         'locale_manager.h',
@@ -31,9 +33,15 @@
         'resource_manager.h',
         'resource_manager.cc',
       ],
+      'defines': [
+        'DECRYPTED_CACHE_SIZE=<(decrypted_cache_size)',
+      ],
       'cflags': [
         '-fvisibility=default',
       ],
+      'libraries': [
+        '-lpthread',
+      ],
       'variables': {
         'packages': [
           'appsvc',
@@ -60,6 +68,19 @@
         ['tizen_feature_watch_face_support == 1', {
           'defines': ['WATCH_FACE_FEATURE_SUPPORT'],
         }],
+        ['appdb_write_behind == 1', {
+          'defines': ['APPDB_WRITE_BEHIND'],
+        }],
+        ['appdb_cache == 1', {
+          'defines': ['APPDB_CACHE'],
+        }],
+        ['appdb_log == 1', {
+          'defines': ['USE_APP_LOG_DB'],
+          'sources': [
+            'app_db_log.h',
+            'app_db_log.cc',
+          ],
+        }],
       ],
       'direct_dependent_settings': {
         'libraries': [
@@ -73,4 +94,53 @@
       },
     },
   ],
+  'conditions': [
+    # Built only with -Dappdb_benchmark=1. The benchmark compiles the AppDB
+    # sources itself instead of linking xwalk_tizen_common, so it needs only
+    # the packages they use, and it logs to stderr instead of dlog.
+    ['appdb_benchmark == 1', {
+      'targets': [
+        {
+          'target_name': 'app_db_benchmark',
+          'type': 'executable',
+          'sources': [
+            'app_db.h',
+            'app_db.cc',
+            'app_db_sqlite.h',
+            'app_db_cache.h',
+            'app_db_cache.cc',
+            'app_db_benchmark.cc',
+            'app_db_benchmark_shim.cc',
+            'file_utils.h',
+            'file_utils.cc',
+            'string_utils.h',
+            'string_utils.cc',
+          ],
+          'cflags': [
+            '<!@(pkg-config --cflags dlog)',
+          ],
+          'libraries': [
+            '-lpthread',
+          ],
+          'variables': {
+            'packages': [
+              'capi-appfw-application',
+              'glib-2.0',
+              'sqlite3',
+              'uuid',
+            ],
+          },
+          'conditions': [
+            ['appdb_log == 1', {
+              'defines': ['USE_APP_LOG_DB'],
+              'sources': [
+                'app_db_log.h',
+                'app_db_log.cc',
+              ],
+            }],
+          ],
+        }, # end of target 'app_db_benchmark'
+      ],
+    }],
+  ],
 }
@@ -72,6 +72,14 @@ const char* kDefaultEncoding = "UTF-8";
 const std::set<std::string> kEncryptedFileExtensions{
     ".html", ".htm", ".css", ".js"};
 
+// Bytes of decrypted resources kept in memory, 0 disables the cache. Set
+// with -Ddecrypted_cache_size=<bytes>.
+#ifdef DECRYPTED_CACHE_SIZE
+const size_t kDecryptedCacheLimit = DECRYPTED_CACHE_SIZE;
+#else
+const size_t kDecryptedCacheLimit = 4 * 1024 * 1024;
+#endif
+
 static std::string GetMimeFromUri(const std::string& uri) {
   // checking passed uri is local file
   std::string file_uri_case(kSchemeTypeFile);
@@ -188,7 +196,8 @@ ResourceManager::ResourceManager(ApplicationData* application_data,
                                  LocaleManager* locale_manager)
     : application_data_(application_data),
       locale_manager_(locale_manager),
-      security_model_version_(0) {
+      security_model_version_(0),
+      decrypted_cache_size_(0) {
   if (application_data != NULL) {
     appid_ = application_data->tizen_application_info()->id();
     if (application_data->csp_info() != NULL ||
@@ -629,15 +638,24 @@ std::string ResourceManager::DecryptResource(const std::string& path) {
       return path;
     }
 
+    // A changed file has another mtime or size, and is decrypted again.
+    std::string cached_url;
+    if (GetDecryptedResource(src_path, buf.st_mtime, file_size, &cached_url))
+      return cached_url;
+
     FILE *src = fopen(src_path.c_str(), "rb");
     if (src == NULL) {
       LOGGER(ERROR) << "Cannot open file for decryption: " << path;
       return path;
     }
 
-    // Read buffer from the source file
-    std::unique_ptr<unsigned char[]> decrypted_str(new unsigned char[file_size]);
-    int decrypted_size = 0;
+    // The decrypted chunks are encoded into the data url as they come, so
+    // neither the whole decrypted file nor a copy of the url is kept.
+    std::string content_type = GetMimeFromUri(path);
+    std::string dst_str = "data:" + content_type + ";base64,";
+    dst_str.reserve(dst_str.size() + (file_size / 3 + 3) * 4);
+    utils::Base64Encoder encoder(&dst_str);
+    size_t in_chunk_size = 0;
 
     do {
       unsigned char get_dec_size[5];
@@ -653,7 +671,10 @@ std::string ResourceManager::DecryptResource(const std::string& path) {
           fclose(src);
           return path;
         }
-        in_chunk.reset(new unsigned char[read_buf_size]);
+        if (read_buf_size > in_chunk_size) {
+          in_chunk.reset(new unsigned char[read_buf_size]);
+          in_chunk_size = read_buf_size;
+        }
 
         size_t dec_read_size =
           fread(in_chunk.get(), 1, read_buf_size, src);
@@ -706,26 +727,79 @@ std::string ResourceManager::DecryptResource(const std::string& path) {
             return path;
           }
 
-          memcpy(decrypted_str.get() + decrypted_size, decrypted_data, decrypted_len);
-          decrypted_size += decrypted_len;
+          encoder.Update(decrypted_data, decrypted_len);
           std::free(decrypted_data);
         }
       }
     } while(0 == std::feof(src));
     fclose(src);
-    memset(decrypted_str.get() + decrypted_size, '\n', file_size - decrypted_size);
+    encoder.Finish();
 
-    // change to data schem
-    std::stringstream dst_str;
-    std::string content_type = GetMimeFromUri(path);
-    std::string encoded = utils::Base64Encode(decrypted_str.get(), decrypted_size);
-    dst_str << "data:" << content_type << ";base64," << encoded;
+    AddDecryptedResource(src_path, buf.st_mtime, file_size, dst_str);
+    return dst_str;
+  }
+  return path;
+}
+
+void ResourceManager::ClearDecryptedCache() {
+  std::lock_guard<std::mutex> lock(decrypted_cache_mutex_);
+  LOGGER(DEBUG) << "Drop " << decrypted_cache_.size()
+                << " decrypted resources, " << decrypted_cache_size_
+                << " bytes";
+  EvictDecryptedResources(0);
+}
 
-    decrypted_str.reset(new unsigned char[file_size]);
+bool ResourceManager::GetDecryptedResource(const std::string& path,
+                                           time_t mtime,
+                                           size_t file_size,
+                                           std::string* url) {
+  std::lock_guard<std::mutex> lock(decrypted_cache_mutex_);
+  auto found = decrypted_cache_index_.find(path);
+  if (found == decrypted_cache_index_.end())
+    return false;
+  auto it = found->second;
+  if (it->mtime != mtime || it->file_size != file_size) {
+    decrypted_cache_size_ -= it->path.size() + it->url.size();
+    decrypted_cache_.erase(it);
+    decrypted_cache_index_.erase(found);
+    return false;
+  }
+  decrypted_cache_.splice(decrypted_cache_.begin(), decrypted_cache_, it);
+  *url = it->url;
+  return true;
+}
 
-    return dst_str.str();
+void ResourceManager::AddDecryptedResource(const std::string& path,
+                                           time_t mtime,
+                                           size_t file_size,
+                                           const std::string& url) {
+  std::lock_guard<std::mutex> lock(decrypted_cache_mutex_);
+  size_t bytes = path.size() + url.size();
+  if (bytes > kDecryptedCacheLimit)
+    return;
+  auto found = decrypted_cache_index_.find(path);
+  if (found != decrypted_cache_index_.end()) {
+    decrypted_cache_size_ -= found->second->path.size() +
+                             found->second->url.size();
+    decrypted_cache_.erase(found->second);
+    decrypted_cache_index_.erase(found);
+  }
+  EvictDecryptedResources(kDecryptedCacheLimit - bytes);
+  DecryptedResource resource = { path, mtime, file_size, url };
+  decrypted_cache_.push_front(resource);
+  decrypted_cache_index_[path] = decrypted_cache_.begin();
+  decrypted_cache_size_ += bytes;
+}
+
+// Drops the least recently used resources until at most |limit| bytes are
+// left. Called with |decrypted_cache_mutex_| held.
+void ResourceManager::EvictDecryptedResources(size_t limit) {
+  while (decrypted_cache_size_ > limit) {
+    const DecryptedResource& last = decrypted_cache_.back();
+    decrypted_cache_size_ -= last.path.size() + last.url.size();
+    decrypted_cache_index_.erase(last.path);
+    decrypted_cache_.pop_back();
   }
-  return path;
 }
 
 }  // namespace common
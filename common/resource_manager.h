@@ -17,8 +17,11 @@
 #ifndef XWALK_COMMON_RESOURCE_MANAGER_H_
 #define XWALK_COMMON_RESOURCE_MANAGER_H_
 
+#include <ctime>
+#include <list>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 
 namespace wgt {
@@ -77,6 +80,8 @@ class ResourceManager {
 
   bool IsEncrypted(const std::string& url);
   std::string DecryptResource(const std::string& path);
+  // Drops the cached decrypted resources, e.g. when the memory is low.
+  void ClearDecryptedCache();
 
   void set_base_resource_path(const std::string& base_path);
 
@@ -91,11 +96,31 @@ class ResourceManager {
   bool CheckAllowNavigation(const std::string& url);
   std::string RemoveLocalePath(const std::string& path);
 
+  // for decryption
+  struct DecryptedResource {
+    std::string path;
+    time_t mtime;
+    size_t file_size;
+    std::string url;
+  };
+  typedef std::list<DecryptedResource> DecryptedResourceList;
+  bool GetDecryptedResource(const std::string& path, time_t mtime,
+                            size_t file_size, std::string* url);
+  void AddDecryptedResource(const std::string& path, time_t mtime,
+                            size_t file_size, const std::string& url);
+  void EvictDecryptedResources(size_t limit);
+
   std::string resource_base_path_;
   std::string appid_;
   std::map<const std::string, bool> file_existed_cache_;
   std::map<const std::string, std::string> locale_cache_;
   std::map<const std::string, bool> warp_cache_;
+  // The most recently used decrypted resource first.
+  DecryptedResourceList decrypted_cache_;
+  std::map<const std::string, DecryptedResourceList::iterator>
+      decrypted_cache_index_;
+  size_t decrypted_cache_size_;
+  std::mutex decrypted_cache_mutex_;
 
   ApplicationData* application_data_;
   LocaleManager* locale_manager_;
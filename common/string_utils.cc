@@ -101,5 +101,26 @@ std::string Base64Encode(const unsigned char* data, size_t len) {
   return std::string(encoded);
 }
 
+Base64Encoder::Base64Encoder(std::string* output)
+    : output_(output), state_(0), save_(0) {
+}
+
+void Base64Encoder::Update(const unsigned char* data, size_t len) {
+  size_t offset = output_->size();
+  // The most g_base64_encode_step() writes, with the saved bytes.
+  output_->resize(offset + (len / 3 + 1) * 4 + 4);
+  size_t written = g_base64_encode_step(data, len, FALSE, &(*output_)[offset],
+                                        &state_, &save_);
+  output_->resize(offset + written);
+}
+
+void Base64Encoder::Finish() {
+  size_t offset = output_->size();
+  output_->resize(offset + 4);
+  size_t written = g_base64_encode_close(FALSE, &(*output_)[offset],
+                                         &state_, &save_);
+  output_->resize(offset + written);
+}
+
 }  // namespace utils
 }  // namespace common
@@ -35,6 +35,21 @@ std::string UrlEncode(const std::string& url);
 std::string UrlDecode(const std::string& url);
 std::string Base64Encode(const unsigned char* data, size_t len);
 
+// Encodes data to base64 piece by piece, so the data does not have to be
+// in memory at once. The encoded text is appended to |output|.
+class Base64Encoder {
+ public:
+  explicit Base64Encoder(std::string* output);
+  void Update(const unsigned char* data, size_t len);
+  // Encodes the bytes which are left from the last Update().
+  void Finish();
+
+ private:
+  std::string* output_;
+  int state_;
+  int save_;
+};
+
 }  // namespace utils
 }  // namespace common
 
@@ -25,6 +25,12 @@ const char kMethodSendSyncMessage[] = "xwalk://SendSyncMessage";
 const char kMethodPostMessage[] = "xwalk://PostMessage";
 const char kMethodGetAPIScript[] = "xwalk://GetAPIScript";
 const char kMethodPostMessageToJS[] = "xwalk://PostMessageToJS";
+const char kMethodPostMessagesToJS[] = "xwalk://PostMessagesToJS";
+const char kMethodOpenStream[] = "xwalk://OpenStream";
+const char kMethodPullStream[] = "xwalk://PullStream";
+const char kMethodCancelStream[] = "xwalk://CancelStream";
+const char kMethodStreamChunkToJS[] = "xwalk://StreamChunkToJS";
+const char kMethodStreamEndToJS[] = "xwalk://StreamEndToJS";
 
 
 }  // namespace extensions
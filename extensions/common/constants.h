@@ -26,6 +26,12 @@ extern const char kMethodSendSyncMessage[];
 extern const char kMethodPostMessage[];
 extern const char kMethodGetAPIScript[];
 extern const char kMethodPostMessageToJS[];
+extern const char kMethodPostMessagesToJS[];
+extern const char kMethodOpenStream[];
+extern const char kMethodPullStream[];
+extern const char kMethodCancelStream[];
+extern const char kMethodStreamChunkToJS[];
+extern const char kMethodStreamEndToJS[];
 
 }  // namespace extensions
 
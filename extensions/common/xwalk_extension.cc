@@ -26,7 +26,10 @@ XWalkExtension::XWalkExtension(const std::string& path,
     shutdown_callback_(NULL),
     handle_msg_callback_(NULL),
     handle_sync_msg_callback_(NULL),
-    handle_binary_msg_callback_(NULL) {
+    handle_binary_msg_callback_(NULL),
+    handle_stream_open_callback_(NULL),
+    handle_stream_pull_callback_(NULL),
+    handle_stream_cancel_callback_(NULL) {
 }
 
 XWalkExtension::XWalkExtension(const std::string& path,
@@ -45,7 +48,10 @@ XWalkExtension::XWalkExtension(const std::string& path,
     shutdown_callback_(NULL),
     handle_msg_callback_(NULL),
     handle_sync_msg_callback_(NULL),
-    handle_binary_msg_callback_(NULL) {
+    handle_binary_msg_callback_(NULL),
+    handle_stream_open_callback_(NULL),
+    handle_stream_pull_callback_(NULL),
+    handle_stream_cancel_callback_(NULL) {
 }
 
 XWalkExtension::~XWalkExtension() {
@@ -13,6 +13,7 @@
 #include "extensions/public/XW_Extension.h"
 #include "extensions/public/XW_Extension_SyncMessage.h"
 #include "extensions/public/XW_Extension_Message_2.h"
+#include "extensions/public/XW_Extension_Stream.h"
 
 namespace extensions {
 
@@ -75,6 +76,9 @@ class XWalkExtension {
   XW_HandleMessageCallback handle_msg_callback_;
   XW_HandleSyncMessageCallback handle_sync_msg_callback_;
   XW_HandleBinaryMessageCallback handle_binary_msg_callback_;
+  XW_HandleStreamOpenCallback handle_stream_open_callback_;
+  XW_HandleStreamPullCallback handle_stream_pull_callback_;
+  XW_HandleStreamCancelCallback handle_stream_cancel_callback_;
 };
 
 }  // namespace extensions
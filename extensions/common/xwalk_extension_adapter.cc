@@ -140,6 +140,15 @@ const void* XWalkExtensionAdapter::GetInterface(const char* name) {
     return &permissionsInterface1;
   }
 
+  if (!strcmp(name, XW_INTERNAL_STREAM_INTERFACE_1)) {
+    static const XW_Internal_StreamInterface_1 streamInterface1 = {
+      StreamRegister,
+      StreamWrite,
+      StreamClose
+    };
+    return &streamInterface1;
+  }
+
   LOGGER(WARN) << "Interface '" << name << "' is not supported.";
   return NULL;
 }
@@ -317,6 +326,34 @@ void XWalkExtensionAdapter::MessagingPostBinaryMessage(
   instance->PostMessageToJS(message);
 }
 
+void XWalkExtensionAdapter::StreamRegister(
+    XW_Extension xw_extension,
+    XW_HandleStreamOpenCallback handle_open,
+    XW_HandleStreamPullCallback handle_pull,
+    XW_HandleStreamCancelCallback handle_cancel) {
+  XWalkExtension* extension = GetExtension(xw_extension);
+  CHECK(extension, xw_extension);
+  RETURN_IF_INITIALIZED(extension);
+  extension->handle_stream_open_callback_ = handle_open;
+  extension->handle_stream_pull_callback_ = handle_pull;
+  extension->handle_stream_cancel_callback_ = handle_cancel;
+}
+
+int XWalkExtensionAdapter::StreamWrite(
+    XW_Instance xw_instance, XW_Stream stream, const char* chunk) {
+  XWalkExtensionInstance* instance = GetExtensionInstance(xw_instance);
+  if (!instance || !chunk)
+    return XW_ERROR;
+  return instance->WriteStreamToJS(stream, chunk);
+}
+
+void XWalkExtensionAdapter::StreamClose(
+    XW_Instance xw_instance, XW_Stream stream, const char* error) {
+  XWalkExtensionInstance* instance = GetExtensionInstance(xw_instance);
+  CHECK(instance, xw_instance);
+  instance->CloseStreamToJS(stream, error);
+}
+
 #undef CHECK
 #undef RETURN_IF_INITIALIZED
 
@@ -14,6 +14,7 @@
 #include "extensions/public/XW_Extension_EntryPoints.h"
 #include "extensions/public/XW_Extension_Permissions.h"
 #include "extensions/public/XW_Extension_Runtime.h"
+#include "extensions/public/XW_Extension_Stream.h"
 #include "extensions/public/XW_Extension_SyncMessage.h"
 #include "extensions/public/XW_Extension_Message_2.h"
 
@@ -83,6 +84,15 @@ class XWalkExtensionAdapter {
       XW_Extension xw_extension, XW_HandleBinaryMessageCallback handle_message);
   static void MessagingPostBinaryMessage(
       XW_Instance xw_instance, const char* message, size_t size);
+  static void StreamRegister(
+      XW_Extension xw_extension,
+      XW_HandleStreamOpenCallback handle_open,
+      XW_HandleStreamPullCallback handle_pull,
+      XW_HandleStreamCancelCallback handle_cancel);
+  static int StreamWrite(
+      XW_Instance xw_instance, XW_Stream stream, const char* chunk);
+  static void StreamClose(
+      XW_Instance xw_instance, XW_Stream stream, const char* error);
 
   ExtensionMap extension_map_;
   InstanceMap instance_map_;
@@ -5,6 +5,11 @@
 
 #include "extensions/common/xwalk_extension_instance.h"
 
+#include <string>
+#include <utility>
+
+#include "common/logger.h"
+#include "extensions/common/constants.h"
 #include "extensions/common/xwalk_extension_adapter.h"
 #include "extensions/public/XW_Extension_SyncMessage.h"
 
@@ -42,6 +47,56 @@ void XWalkExtensionInstance::HandleSyncMessage(const std::string& msg) {
   }
 }
 
+void XWalkExtensionInstance::HandleStreamOpen(XW_Stream stream, int credit,
+                                              const std::string& msg) {
+  {
+    std::lock_guard<std::mutex> lock(streams_mutex_);
+    // A stream id which is still open must not be taken over, or the chunks
+    // of both streams would be mixed.
+    if (!streams_.insert(std::make_pair(stream, credit)).second) {
+      LOGGER(ERROR) << "Stream " << stream << " is already open";
+      return;
+    }
+  }
+
+  XW_HandleStreamOpenCallback callback =
+      extension_->handle_stream_open_callback_;
+  if (!callback) {
+    CloseStreamToJS(stream, "Streams are not supported by the extension");
+    return;
+  }
+  callback(xw_instance_, stream, msg.c_str(), credit);
+}
+
+void XWalkExtensionInstance::HandleStreamPull(XW_Stream stream, int credit) {
+  {
+    std::lock_guard<std::mutex> lock(streams_mutex_);
+    auto it = streams_.find(stream);
+    if (it == streams_.end())
+      return;
+    it->second += credit;
+    credit = it->second;
+  }
+
+  XW_HandleStreamPullCallback callback =
+      extension_->handle_stream_pull_callback_;
+  if (callback)
+    callback(xw_instance_, stream, credit);
+}
+
+void XWalkExtensionInstance::HandleStreamCancel(XW_Stream stream) {
+  {
+    std::lock_guard<std::mutex> lock(streams_mutex_);
+    if (!streams_.erase(stream))
+      return;
+  }
+
+  XW_HandleStreamCancelCallback callback =
+      extension_->handle_stream_cancel_callback_;
+  if (callback)
+    callback(xw_instance_, stream);
+}
+
 void XWalkExtensionInstance::SetPostMessageCallback(
     MessageCallback callback) {
   post_message_callback_ = callback;
@@ -52,6 +107,10 @@ void XWalkExtensionInstance::SetSendSyncReplyCallback(
   send_sync_reply_callback_ = callback;
 }
 
+void XWalkExtensionInstance::SetStreamCallback(StreamCallback callback) {
+  stream_callback_ = callback;
+}
+
 void XWalkExtensionInstance::PostMessageToJS(const std::string& msg) {
   post_message_callback_(msg);
 }
@@ -60,4 +119,34 @@ void XWalkExtensionInstance::SyncReplyToJS(const std::string& reply) {
   send_sync_reply_callback_(reply);
 }
 
+// The stream events are sent as "<stream>:<chunk or error>".
+int XWalkExtensionInstance::WriteStreamToJS(XW_Stream stream,
+                                            const std::string& chunk) {
+  {
+    std::lock_guard<std::mutex> lock(streams_mutex_);
+    auto it = streams_.find(stream);
+    if (it == streams_.end() || it->second <= 0)
+      return XW_ERROR;
+    it->second--;
+  }
+
+  stream_callback_(kMethodStreamChunkToJS,
+                   std::to_string(stream) + ":" + chunk);
+  return XW_OK;
+}
+
+void XWalkExtensionInstance::CloseStreamToJS(XW_Stream stream,
+                                             const char* error) {
+  {
+    std::lock_guard<std::mutex> lock(streams_mutex_);
+    if (!streams_.erase(stream))
+      return;
+  }
+
+  std::string msg = std::to_string(stream) + ":";
+  if (error)
+    msg += error;
+  stream_callback_(kMethodStreamEndToJS, msg);
+}
+
 }  // namespace extensions
@@ -7,9 +7,12 @@
 #define XWALK_EXTENSIONS_XWALK_EXTENSION_INSTANCE_H_
 
 #include <functional>
+#include <map>
+#include <mutex>
 #include <string>
 
 #include "extensions/public/XW_Extension.h"
+#include "extensions/public/XW_Extension_Stream.h"
 
 namespace extensions {
 
@@ -18,6 +21,8 @@ class XWalkExtension;
 class XWalkExtensionInstance {
  public:
   typedef std::function<void(const std::string&)> MessageCallback;
+  typedef std::function<void(const char* type, const std::string&)>
+      StreamCallback;
 
   XWalkExtensionInstance(XWalkExtension* extension, XW_Instance xw_instance);
   virtual ~XWalkExtensionInstance();
@@ -25,14 +30,21 @@ class XWalkExtensionInstance {
   void HandleMessage(const std::string& msg);
   void HandleSyncMessage(const std::string& msg);
 
+  void HandleStreamOpen(XW_Stream stream, int credit, const std::string& msg);
+  void HandleStreamPull(XW_Stream stream, int credit);
+  void HandleStreamCancel(XW_Stream stream);
+
   void SetPostMessageCallback(MessageCallback callback);
   void SetSendSyncReplyCallback(MessageCallback callback);
+  void SetStreamCallback(StreamCallback callback);
 
  private:
   friend class XWalkExtensionAdapter;
 
   void PostMessageToJS(const std::string& msg);
   void SyncReplyToJS(const std::string& reply);
+  int WriteStreamToJS(XW_Stream stream, const std::string& chunk);
+  void CloseStreamToJS(XW_Stream stream, const char* error);
 
   XWalkExtension* extension_;
   XW_Instance xw_instance_;
@@ -40,6 +52,12 @@ class XWalkExtensionInstance {
 
   MessageCallback post_message_callback_;
   MessageCallback send_sync_reply_callback_;
+  StreamCallback stream_callback_;
+
+  // Credit left to each open stream, i.e. the number of chunks it can still
+  // write. The streams may be written from any thread.
+  std::map<XW_Stream, int> streams_;
+  std::mutex streams_mutex_;
 };
 
 }  // namespace extensions
@@ -5,6 +5,7 @@
 #include "extensions/common/xwalk_extension_server.h"
 
 #include <Ecore.h>
+#include <stdlib.h>
 
 #include <string>
 
@@ -16,13 +17,28 @@
 
 namespace extensions {
 
+namespace {
+
+// Whether the messages posted to JS are batched. Set with
+// -Dmessage_batching=1.
+#ifdef MESSAGE_BATCHING
+const bool kBatchMessages = true;
+#else
+const bool kBatchMessages = false;
+#endif
+
+}  // namespace
+
 // static
 XWalkExtensionServer* XWalkExtensionServer::GetInstance() {
   static XWalkExtensionServer self;
   return &self;
 }
 
-XWalkExtensionServer::XWalkExtensionServer() {
+XWalkExtensionServer::XWalkExtensionServer()
+    : ewk_context_(NULL),
+      flush_job_(NULL),
+      flush_scheduled_(false) {
   manager_.LoadExtensions();
 }
 
@@ -38,6 +54,15 @@ void XWalkExtensionServer::Preload() {
 }
 
 void XWalkExtensionServer::Shutdown() {
+  {
+    std::lock_guard<std::mutex> lock(pending_mutex_);
+    if (flush_job_) {
+      ecore_job_del(flush_job_);
+      flush_job_ = NULL;
+    }
+    flush_scheduled_ = false;
+    pending_messages_.clear();
+  }
   for (auto it = instances_.begin(); it != instances_.end(); ++it) {
     delete it->second;
   }
@@ -85,14 +110,11 @@ std::string XWalkExtensionServer::CreateInstance(
       instance_id = common::utils::GenerateUUID();
       instance->SetPostMessageCallback(
           [this, instance_id](const std::string& msg) {
-        Ewk_IPC_Wrt_Message_Data* ans = ewk_ipc_wrt_message_data_new();
-        ewk_ipc_wrt_message_data_type_set(ans, kMethodPostMessageToJS);
-        ewk_ipc_wrt_message_data_id_set(ans, instance_id.c_str());
-        ewk_ipc_wrt_message_data_value_set(ans, msg.c_str());
-        if (!ewk_ipc_wrt_message_send(ewk_context_, ans)) {
-          LOGGER(ERROR) << "Failed to send response";
-        }
-        ewk_ipc_wrt_message_data_del(ans);
+        PostMessageToJS(instance_id, msg);
+      });
+      instance->SetStreamCallback(
+          [this, instance_id](const char* type, const std::string& msg) {
+        SendMessageToJSInOrder(type, instance_id, msg);
       });
 
       instances_[instance_id] = instance;
@@ -106,6 +128,110 @@ std::string XWalkExtensionServer::CreateInstance(
   return instance_id;
 }
 
+// With -Dmessage_batching=1, the messages posted to JS are queued and sent
+// once the current main loop iteration is done, so a burst of messages for an
+// instance reaches the renderer as a single IPC message.
+void XWalkExtensionServer::PostMessageToJS(const std::string& instance_id,
+                                           const std::string& msg) {
+  if (!kBatchMessages) {
+    SendMessageToJS(kMethodPostMessageToJS, instance_id, msg);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(pending_mutex_);
+    pending_messages_[instance_id].push_back(msg);
+    if (flush_scheduled_)
+      return;
+    flush_scheduled_ = true;
+  }
+  // Messages posted from other threads are queued as well, so they can't
+  // overtake the ones queued before them.
+  auto schedule_flush = [](void* data) {
+    XWalkExtensionServer* self = static_cast<XWalkExtensionServer*>(data);
+    self->flush_job_ = ecore_job_add([](void* data) {
+      static_cast<XWalkExtensionServer*>(data)->FlushPendingMessages();
+    }, self);
+  };
+  if (eina_main_loop_is())
+    schedule_flush(this);
+  else
+    ecore_main_loop_thread_safe_call_async(schedule_flush, this);
+}
+
+// Sends a message which is not queued, e.g. a stream chunk, after the
+// messages queued for the instance.
+void XWalkExtensionServer::SendMessageToJSInOrder(
+    const char* type, const std::string& instance_id, const std::string& msg) {
+  std::lock_guard<std::mutex> lock(pending_mutex_);
+  auto it = pending_messages_.find(instance_id);
+  if (it != pending_messages_.end()) {
+    SendPendingMessagesLocked(it->first, it->second);
+    pending_messages_.erase(it);
+  }
+  SendMessageToJS(type, instance_id, msg);
+}
+
+void XWalkExtensionServer::FlushPendingMessages() {
+  std::lock_guard<std::mutex> lock(pending_mutex_);
+  flush_job_ = NULL;
+  flush_scheduled_ = false;
+  for (auto it = pending_messages_.begin(); it != pending_messages_.end();
+       ++it) {
+    SendPendingMessagesLocked(it->first, it->second);
+  }
+  pending_messages_.clear();
+}
+
+// Sends the queued messages of an instance before a reply to it, e.g. to a
+// sync message, which would overtake them otherwise.
+void XWalkExtensionServer::FlushPendingMessages(
+    const std::string& instance_id) {
+  std::lock_guard<std::mutex> lock(pending_mutex_);
+  auto it = pending_messages_.find(instance_id);
+  if (it == pending_messages_.end())
+    return;
+  SendPendingMessagesLocked(it->first, it->second);
+  pending_messages_.erase(it);
+}
+
+// A single message is sent as is. Several ones are sent as
+// kMethodPostMessagesToJS, each of them prefixed by its length in bytes and
+// a colon, e.g. "5:hello3:foo".
+void XWalkExtensionServer::SendPendingMessagesLocked(
+    const std::string& instance_id, const std::vector<std::string>& msgs) {
+  if (msgs.size() == 1) {
+    SendMessageToJS(kMethodPostMessageToJS, instance_id, msgs.front());
+    return;
+  }
+
+  size_t length = 0;
+  for (auto msg = msgs.begin(); msg != msgs.end(); ++msg) {
+    length += msg->size() + 16;
+  }
+  std::string value;
+  value.reserve(length);
+  for (auto msg = msgs.begin(); msg != msgs.end(); ++msg) {
+    value += std::to_string(msg->size());
+    value += ':';
+    value += *msg;
+  }
+  SendMessageToJS(kMethodPostMessagesToJS, instance_id, value);
+}
+
+void XWalkExtensionServer::SendMessageToJS(const char* type,
+                                           const std::string& instance_id,
+                                           const std::string& msg) {
+  Ewk_IPC_Wrt_Message_Data* ans = ewk_ipc_wrt_message_data_new();
+  ewk_ipc_wrt_message_data_type_set(ans, type);
+  ewk_ipc_wrt_message_data_id_set(ans, instance_id.c_str());
+  ewk_ipc_wrt_message_data_value_set(ans, msg.c_str());
+  if (!ewk_ipc_wrt_message_send(ewk_context_, ans)) {
+    LOGGER(ERROR) << "Failed to send response";
+  }
+  ewk_ipc_wrt_message_data_del(ans);
+}
+
 void XWalkExtensionServer::HandleIPCMessage(Ewk_IPC_Wrt_Message_Data* data) {
   if (!data) {
     LOGGER(ERROR) << "Invalid parameter. data is NULL.";
@@ -132,6 +258,9 @@ void XWalkExtensionServer::HandleIPCMessage(Ewk_IPC_Wrt_Message_Data* data) {
     HandleSendSyncMessageToNative(data);
   } else if (TYPE_IS(kMethodGetAPIScript)) {
     HandleGetAPIScript(data);
+  } else if (TYPE_IS(kMethodOpenStream) || TYPE_IS(kMethodPullStream) ||
+             TYPE_IS(kMethodCancelStream)) {
+    HandleStreamMessageToNative(data, msg_type);
   }
 
   eina_stringshare_del(msg_type);
@@ -165,6 +294,8 @@ void XWalkExtensionServer::HandleDestroyInstance(
     XWalkExtensionInstance* instance = it->second;
     delete instance;
     instances_.erase(it);
+    std::lock_guard<std::mutex> lock(pending_mutex_);
+    pending_messages_.erase(instance_id);
   } else {
     LOGGER(ERROR) << "No such instance '" << instance_id << "'";
   }
@@ -189,6 +320,43 @@ void XWalkExtensionServer::HandlePostMessageToNative(
   eina_stringshare_del(instance_id);
 }
 
+// The reference id of a stream message is the stream. The value is
+// "<credit>:<request>" to open it, "<credit>" to pull from it, and empty to
+// cancel it.
+void XWalkExtensionServer::HandleStreamMessageToNative(
+    Ewk_IPC_Wrt_Message_Data* data, const char* type) {
+  Eina_Stringshare* instance_id = ewk_ipc_wrt_message_data_id_get(data);
+
+  auto it = instances_.find(instance_id);
+  if (it == instances_.end()) {
+    LOGGER(ERROR) << "No such instance '" << instance_id << "'";
+    eina_stringshare_del(instance_id);
+    return;
+  }
+
+  XWalkExtensionInstance* instance = it->second;
+  Eina_Stringshare* stream_id = ewk_ipc_wrt_message_data_reference_id_get(data);
+  Eina_Stringshare* value = ewk_ipc_wrt_message_data_value_get(data);
+  XW_Stream stream = atoi(stream_id);
+
+  if (!strcmp(type, kMethodCancelStream)) {
+    instance->HandleStreamCancel(stream);
+  } else {
+    char* end = NULL;
+    int credit = strtol(value, &end, 10);
+    if (!strcmp(type, kMethodPullStream))
+      instance->HandleStreamPull(stream, credit);
+    else if (*end == ':')
+      instance->HandleStreamOpen(stream, credit, std::string(end + 1));
+    else
+      LOGGER(ERROR) << "Malformed stream request for '" << instance_id << "'";
+  }
+
+  eina_stringshare_del(value);
+  eina_stringshare_del(stream_id);
+  eina_stringshare_del(instance_id);
+}
+
 void XWalkExtensionServer::HandleSendSyncMessageToNative(
     Ewk_IPC_Wrt_Message_Data* data) {
   Eina_Stringshare* instance_id = ewk_ipc_wrt_message_data_id_get(data);
@@ -198,10 +366,18 @@ void XWalkExtensionServer::HandleSendSyncMessageToNative(
     Eina_Stringshare* msg = ewk_ipc_wrt_message_data_value_get(data);
     XWalkExtensionInstance* instance = it->second;
     std::string reply;
-    instance->SetSendSyncReplyCallback([&reply](const std::string& msg) {
+    bool replied = false;
+    instance->SetSendSyncReplyCallback(
+        [&reply, &replied](const std::string& msg) {
       reply = msg;
+      replied = true;
     });
     instance->HandleSyncMessage(msg);
+    FlushPendingMessages(instance_id);
+    if (!replied) {
+      LOGGER(WARN) << "Instance '" << instance_id
+                   << "' did not reply to the sync message";
+    }
     ewk_ipc_wrt_message_data_value_set(data, reply.c_str());
     eina_stringshare_del(msg);
   } else {
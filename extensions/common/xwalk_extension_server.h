@@ -5,12 +5,15 @@
 #ifndef XWALK_EXTENSIONS_XWALK_EXTENSION_SERVER_H_
 #define XWALK_EXTENSIONS_XWALK_EXTENSION_SERVER_H_
 
+#include <Ecore.h>
 #include <EWebKit.h>
 #include <EWebKit_internal.h>
 #include <json/json.h>
 
 #include <string>
 #include <map>
+#include <mutex>
+#include <vector>
 
 #include "extensions/common/xwalk_extension_manager.h"
 #include "extensions/common/xwalk_extension_instance.h"
@@ -42,14 +45,39 @@ class XWalkExtensionServer {
   void HandlePostMessageToNative(Ewk_IPC_Wrt_Message_Data* data);
   void HandleSendSyncMessageToNative(Ewk_IPC_Wrt_Message_Data* data);
   void HandleGetAPIScript(Ewk_IPC_Wrt_Message_Data* data);
+  void HandleStreamMessageToNative(Ewk_IPC_Wrt_Message_Data* data,
+                                   const char* type);
+
+  void PostMessageToJS(const std::string& instance_id,
+                       const std::string& msg);
+  void SendMessageToJS(const char* type,
+                       const std::string& instance_id,
+                       const std::string& msg);
+  void SendMessageToJSInOrder(const char* type,
+                              const std::string& instance_id,
+                              const std::string& msg);
+  void FlushPendingMessages();
+  void FlushPendingMessages(const std::string& instance_id);
+  void SendPendingMessagesLocked(const std::string& instance_id,
+                                 const std::vector<std::string>& msgs);
 
   typedef std::map<std::string, XWalkExtensionInstance*> InstanceMap;
+  typedef std::map<std::string, std::vector<std::string> > MessageQueueMap;
 
   Ewk_Context* ewk_context_;
 
   XWalkExtensionManager manager_;
 
   InstanceMap instances_;
+
+  // Messages posted to JS during the current main loop iteration, sent at
+  // once per instance by |flush_job_|. Only used with -Dmessage_batching=1.
+  MessageQueueMap pending_messages_;
+  Ecore_Job* flush_job_;
+  bool flush_scheduled_;
+  // Guards the members above. Also held while the messages of an instance
+  // are sent, so they reach the renderer in the order they were posted.
+  std::mutex pending_mutex_;
 };
 
 }  // namespace extensions
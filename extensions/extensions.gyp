@@ -38,16 +38,29 @@
         'renderer/object_tools_module.cc',
         'renderer/runtime_ipc_client.h',
         'renderer/runtime_ipc_client.cc',
+        'renderer/sync_message_watchdog.h',
+        'renderer/sync_message_watchdog.cc',
       ],
       'cflags': [
         '-fvisibility=default',
       ],
+      'libraries': [
+        '-lpthread',
+      ],
       'variables': {
         'packages': [
           'chromium-efl',
           'elementary',
         ],
       },
+      'conditions': [
+        ['namespace_interceptor == 1', {
+          'defines': ['NAMESPACE_INTERCEPTOR'],
+        }],
+        ['message_batching == 1', {
+          'defines': ['MESSAGE_BATCHING'],
+        }],
+      ],
       'direct_dependent_settings': {
         'libraries': [
           '-lxwalk_extension_shared',
@@ -0,0 +1,87 @@
+// Copyright (c) 2015 Samsung Electronics Co., Ltd. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef XWALK_EXTENSIONS_PUBLIC_XW_EXTENSION_STREAM_H_
+#define XWALK_EXTENSIONS_PUBLIC_XW_EXTENSION_STREAM_H_
+
+// NOTE: This file and interfaces marked as internal are not considered stable
+// and can be modified in incompatible ways between Crosswalk versions.
+
+#ifndef XWALK_EXTENSIONS_PUBLIC_XW_EXTENSION_H_
+#error "You should include XW_Extension.h before this file"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// XW_INTERNAL_STREAM_INTERFACE: allow extension code to reply to a request
+// of the JavaScript code with a stream of chunks, instead of a single
+// message. The JavaScript code opens a stream with extension.openStream(),
+// which returns an object whose read() method returns a promise of the next
+// chunk, and that can be iterated with "for await" where it is supported.
+//
+// The stream is flow controlled: the extension may only write as many chunks
+// as the credit it was given. The JavaScript side grants more credit as
+// its chunks are read, and the extension is then notified by the pull
+// callback.
+//
+
+#define XW_INTERNAL_STREAM_INTERFACE_1 \
+  "XW_InternalStreamInterface_1"
+#define XW_INTERNAL_STREAM_INTERFACE \
+  XW_INTERNAL_STREAM_INTERFACE_1
+
+// Identifies a stream of an instance. The zero value is never used.
+typedef int32_t XW_Stream;
+
+// Called when the JavaScript code opens a stream, |message| is the request
+// passed to extension.openStream(). |credit| is the number of chunks which
+// can be written right away.
+typedef void (*XW_HandleStreamOpenCallback)(XW_Instance instance,
+                                            XW_Stream stream,
+                                            const char* message,
+                                            int credit);
+
+// Called when the JavaScript code is ready for more chunks, |credit| is the
+// number of chunks which can now be written.
+typedef void (*XW_HandleStreamPullCallback)(XW_Instance instance,
+                                            XW_Stream stream,
+                                            int credit);
+
+// Called when the JavaScript code is not interested in the stream anymore.
+// The stream must not be written or closed after that.
+typedef void (*XW_HandleStreamCancelCallback)(XW_Instance instance,
+                                              XW_Stream stream);
+
+struct XW_Internal_StreamInterface_1 {
+  void (*Register)(XW_Extension extension,
+                   XW_HandleStreamOpenCallback handle_open,
+                   XW_HandleStreamPullCallback handle_pull,
+                   XW_HandleStreamCancelCallback handle_cancel);
+
+  // Writes a chunk to the stream. Returns XW_ERROR without writing it if the
+  // stream has no credit left, or is not open anymore.
+  //
+  // This function is thread-safe and can be called until the instance is
+  // destroyed.
+  int (*Write)(XW_Instance instance, XW_Stream stream, const char* chunk);
+
+  // Ends the stream after the chunks written so far. If |error| is not NULL,
+  // the stream fails with it as message instead.
+  //
+  // This function is thread-safe and can be called until the instance is
+  // destroyed.
+  void (*Close)(XW_Instance instance, XW_Stream stream, const char* error);
+};
+
+typedef struct XW_Internal_StreamInterface_1
+    XW_Internal_StreamInterface;
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // XWALK_EXTENSIONS_PUBLIC_XW_EXTENSION_STREAM_H_
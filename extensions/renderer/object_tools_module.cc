@@ -18,6 +18,7 @@
 
 #include <v8/v8.h>
 
+#include <map>
 #include <string>
 
 #include "common/logger.h"
@@ -44,71 +45,98 @@ const char *kCreateObjectCode =
     "  };"
     "}(Object));";
 
-v8::Handle<v8::Value> RunString(const std::string& code) {
-  v8::Isolate* isolate = v8::Isolate::GetCurrent();
-  v8::EscapableHandleScope handle_scope(isolate);
-  v8::Handle<v8::String> v8_code(
-      v8::String::NewFromUtf8(isolate, code.c_str()));
+// Slot of the context which keeps the function returned by the create object
+// code run in that context.
+const int kCreateFunctionEmbedderDataIndex = 13;
+
+// The create object code doesn't depend on the context it runs in, so it is
+// compiled once per isolate and only bound to each new context.
+v8::Handle<v8::UnboundScript> GetCreateObjectScript(v8::Isolate* isolate) {
+  static std::map<v8::Isolate*, v8::Persistent<v8::UnboundScript>*> scripts;
+  auto it = scripts.find(isolate);
+  if (it != scripts.end())
+    return v8::Local<v8::UnboundScript>::New(isolate, *it->second);
 
+  v8::EscapableHandleScope handle_scope(isolate);
   v8::TryCatch try_catch;
   try_catch.SetVerbose(true);
 
-  v8::Handle<v8::Script> script(v8::Script::Compile(v8_code));
-  if (try_catch.HasCaught()) {
+  v8::ScriptCompiler::Source source(
+      v8::String::NewFromUtf8(isolate, kCreateObjectCode));
+  v8::Local<v8::UnboundScript> script =
+      v8::ScriptCompiler::CompileUnbound(isolate, &source);
+  if (try_catch.HasCaught() || script.IsEmpty()) {
     v8::String::Utf8Value exception(try_catch.Exception());
     LOGGER(ERROR) << "Error occurred(script compile):" << *exception;
-    return handle_scope.Escape(
-        v8::Local<v8::Primitive>(v8::Undefined(isolate)));
+    return v8::Handle<v8::UnboundScript>();
   }
 
-  v8::Local<v8::Value> result = script->Run();
-  if (try_catch.HasCaught()) {
-    v8::String::Utf8Value exception(try_catch.Exception());
-    LOGGER(ERROR) << "Error occurred(script run):" << *exception;
-    return handle_scope.Escape(
-        v8::Local<v8::Primitive>(v8::Undefined(isolate)));
-  }
-  return handle_scope.Escape(result);
+  scripts[isolate] = new v8::Persistent<v8::UnboundScript>(isolate, script);
+  return handle_scope.Escape(script);
 }
 }  //  namespace
 
 
 ObjectToolsModule::ObjectToolsModule() {
-  v8::Isolate* isolate = v8::Isolate::GetCurrent();
+}
+
+ObjectToolsModule::~ObjectToolsModule() {
+}
+
+// The create object code copies the Object functions as they are when it
+// runs, so it runs when the context is created, before any page script can
+// replace them. Only the compiled code is shared between the contexts.
+// static
+void ObjectToolsModule::InitializeContext(v8::Handle<v8::Context> context) {
+  v8::Isolate* isolate = context->GetIsolate();
   v8::HandleScope handle_scope(isolate);
+  v8::Context::Scope context_scope(context);
+  // The slot is set even if the code fails, so NewInstance() can read it.
+  context->SetEmbedderData(kCreateFunctionEmbedderDataIndex,
+                           v8::Undefined(isolate));
+
+  v8::Handle<v8::UnboundScript> unbound_script =
+      GetCreateObjectScript(isolate);
+  if (unbound_script.IsEmpty())
+    return;
+
+  v8::TryCatch try_catch;
+  try_catch.SetVerbose(true);
 
-  v8::Handle<v8::Value> result = RunString(kCreateObjectCode);
+  v8::Local<v8::Value> result = unbound_script->BindToCurrentContext()->Run();
+  if (try_catch.HasCaught()) {
+    v8::String::Utf8Value exception(try_catch.Exception());
+    LOGGER(ERROR) << "Error occurred(script run):" << *exception;
+    return;
+  }
   if (!result->IsFunction()) {
     LOGGER(ERROR) << "Couldn't load Object Create function";
     return;
   }
-  v8::Handle<v8::Function> create_function =
-      v8::Handle<v8::Function>::Cast(result);
-
-  create_function_.Reset(isolate, create_function);
-}
-
-ObjectToolsModule::~ObjectToolsModule() {
-  create_function_.Reset();
+  context->SetEmbedderData(kCreateFunctionEmbedderDataIndex, result);
 }
 
 v8::Handle<v8::Object> ObjectToolsModule::NewInstance() {
   v8::Isolate* isolate = v8::Isolate::GetCurrent();
-  if (create_function_.IsEmpty()) {
-    return v8::Object::New(isolate);
+  v8::EscapableHandleScope handle_scope(isolate);
+
+  v8::Handle<v8::Context> context = isolate->GetCurrentContext();
+  v8::Handle<v8::Value> result =
+      context->GetEmbedderData(kCreateFunctionEmbedderDataIndex);
+  if (result.IsEmpty() || !result->IsFunction()) {
+    LOGGER(ERROR) << "Couldn't load Object Create function";
+    return handle_scope.Escape(v8::Object::New(isolate));
   }
-  v8::Handle<v8::Function> function =
-      v8::Local<v8::Function>::New(isolate, create_function_);
+  v8::Handle<v8::Function> create_function =
+      v8::Handle<v8::Function>::Cast(result);
 
-  v8::Handle<v8::Context> context = v8::Context::New(isolate);
   v8::TryCatch try_catch;
-  v8::Handle<v8::Value> ret = function->Call(context->Global(), 0, NULL);
-  if (try_catch.HasCaught()) {
+  v8::Handle<v8::Value> ret = create_function->Call(context->Global(), 0, NULL);
+  if (try_catch.HasCaught() || !ret->IsObject()) {
     LOGGER(ERROR) << "Exception when running create function: ";
-    return v8::Object::New(isolate);
+    return handle_scope.Escape(v8::Object::New(isolate));
   }
-  return v8::Handle<v8::Object>::Cast(ret);
+  return handle_scope.Escape(v8::Handle<v8::Object>::Cast(ret));
 }
 
 }  // namespace extensions
-
@@ -26,9 +26,12 @@ class ObjectToolsModule : public XWalkNativeModule {
   ObjectToolsModule();
   ~ObjectToolsModule() override;
 
+  // Runs the create object code in |context|. Called when the context is
+  // created, as the code keeps the Object functions of that time.
+  static void InitializeContext(v8::Handle<v8::Context> context);
+
  private:
   v8::Handle<v8::Object> NewInstance() override;
-  v8::Persistent<v8::Function> create_function_;
 };
 
 }  // namespace extensions
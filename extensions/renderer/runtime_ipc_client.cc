@@ -15,11 +15,17 @@
  */
 
 #include "extensions/renderer/runtime_ipc_client.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "extensions/renderer/sync_message_watchdog.h"
 #include "extensions/renderer/xwalk_extension_renderer_controller.h"
+#include "extensions/renderer/xwalk_module_system.h"
 
 #include "common/logger.h"
 #include "common/profiler.h"
-#include "common/string_utils.h"
 
 namespace extensions {
 
@@ -60,7 +66,15 @@ RuntimeIPCClient* RuntimeIPCClient::GetInstance() {
   return &self;
 }
 
-RuntimeIPCClient::RuntimeIPCClient() {
+RuntimeIPCClient::RuntimeIPCClient()
+    : expiry_timer_(NULL),
+      next_message_id_(0) {
+}
+
+// static
+const void* RuntimeIPCClient::GetOwner(v8::Handle<v8::Context> context) {
+  // A context has its own module system until it is released.
+  return XWalkModuleSystem::GetModuleSystemFromContext(context);
 }
 
 int RuntimeIPCClient::GetRoutingId(v8::Handle<v8::Context> context) {
@@ -143,6 +157,15 @@ std::string RuntimeIPCClient::SendSyncMessage(v8::Handle<v8::Context> context,
                                               const std::string& id,
                                               const std::string& ref_id,
                                               const std::string& value) {
+  return SendSyncMessage(context, type, id, ref_id, value, std::string());
+}
+
+std::string RuntimeIPCClient::SendSyncMessage(v8::Handle<v8::Context> context,
+                                              const std::string& type,
+                                              const std::string& id,
+                                              const std::string& ref_id,
+                                              const std::string& value,
+                                              const std::string& source) {
   int routing_id = GetRoutingId(context);
   if (routing_id < 1) {
     LOGGER(ERROR) << "Invalid routing handle for IPC.";
@@ -155,6 +178,8 @@ std::string RuntimeIPCClient::SendSyncMessage(v8::Handle<v8::Context> context,
   ewk_ipc_wrt_message_data_reference_id_set(msg, ref_id.c_str());
   ewk_ipc_wrt_message_data_value_set(msg, value.c_str());
 
+  SyncMessageWatchdog::Scope watchdog(source, type);
+
   if (!ewk_ipc_plugins_sync_message_send(routing_id, msg)) {
     LOGGER(ERROR) << "Failed to send message to runtime using ewk_ipc.";
     ewk_ipc_wrt_message_data_del(msg);
@@ -173,28 +198,38 @@ std::string RuntimeIPCClient::SendSyncMessage(v8::Handle<v8::Context> context,
 void RuntimeIPCClient::SendAsyncMessage(v8::Handle<v8::Context> context,
                                         const std::string& type,
                                         const std::string& value,
-                                        ReplyCallback callback) {
+                                        ReplyCallback callback,
+                                        int timeout_ms,
+                                        TimeoutCallback on_timeout) {
   int routing_id = GetRoutingId(context);
   if (routing_id < 1) {
     LOGGER(ERROR) << "Invalid routing handle for IPC.";
     return;
   }
 
-  std::string msg_id = common::utils::GenerateUUID();
+  std::string msg_id = std::to_string(++next_message_id_);
 
   Ewk_IPC_Wrt_Message_Data* msg = ewk_ipc_wrt_message_data_new();
   ewk_ipc_wrt_message_data_id_set(msg, msg_id.c_str());
   ewk_ipc_wrt_message_data_type_set(msg, type.c_str());
   ewk_ipc_wrt_message_data_value_set(msg, value.c_str());
 
+  // The callback is registered before sending, so a reply handled while the
+  // message is sent is not missed.
+  Clock::time_point deadline = Clock::time_point::max();
+  if (timeout_ms > 0)
+    deadline = Clock::now() + std::chrono::milliseconds(timeout_ms);
+  PendingCallback pending = { callback, on_timeout, deadline,
+                              GetOwner(context) };
+  callbacks_[msg_id] = pending;
+
   if (!ewk_ipc_plugins_message_send(routing_id, msg)) {
     LOGGER(ERROR) << "Failed to send message to runtime using ewk_ipc.";
-    ewk_ipc_wrt_message_data_del(msg);
-    return;
+    callbacks_.erase(msg_id);
+  } else if (timeout_ms > 0) {
+    ArmExpiryTimer(deadline);
   }
 
-  callbacks_[msg_id] = callback;
-
   ewk_ipc_wrt_message_data_del(msg);
 }
 
@@ -223,16 +258,86 @@ void RuntimeIPCClient::HandleMessageFromRuntime(
   Eina_Stringshare* msg_type = ewk_ipc_wrt_message_data_type_get(msg);
   Eina_Stringshare* msg_value = ewk_ipc_wrt_message_data_value_get(msg);
 
-  ReplyCallback func = it->second;
+  // The callback may send another message, which changes |callbacks_|.
+  ReplyCallback func = it->second.callback;
+  callbacks_.erase(it);
   if (func) {
     func(msg_type, msg_value);
   }
 
-  callbacks_.erase(it);
-
   eina_stringshare_del(msg_refid);
   eina_stringshare_del(msg_type);
   eina_stringshare_del(msg_value);
 }
 
+void RuntimeIPCClient::CancelPendingMessages(v8::Handle<v8::Context> context) {
+  const void* owner = GetOwner(context);
+  if (!owner)
+    return;
+
+  size_t cancelled = 0;
+  for (auto it = callbacks_.begin(); it != callbacks_.end(); ) {
+    if (it->second.owner == owner) {
+      it = callbacks_.erase(it);
+      ++cancelled;
+    } else {
+      ++it;
+    }
+  }
+
+  if (cancelled) {
+    LOGGER(DEBUG) << "Cancelled " << cancelled
+                  << " pending message(s) of the released context.";
+  }
+}
+
+void RuntimeIPCClient::RunExpiredCallbacks() {
+  Clock::time_point now = Clock::now();
+
+  // The timeout callbacks may send other messages, so they are called once
+  // the expired ones are removed.
+  std::vector<std::pair<std::string, PendingCallback> > expired;
+  Clock::time_point next_deadline = Clock::time_point::max();
+  for (auto it = callbacks_.begin(); it != callbacks_.end(); ) {
+    if (it->second.deadline <= now) {
+      expired.push_back(*it);
+      it = callbacks_.erase(it);
+    } else {
+      if (it->second.deadline < next_deadline)
+        next_deadline = it->second.deadline;
+      ++it;
+    }
+  }
+  if (next_deadline != Clock::time_point::max())
+    ArmExpiryTimer(next_deadline);
+
+  for (auto it = expired.begin(); it != expired.end(); ++it) {
+    LOGGER(WARN) << "No reply for the message " << it->first
+                 << " before its deadline.";
+    if (it->second.on_timeout)
+      it->second.on_timeout();
+  }
+}
+
+// The timer is only moved to an earlier deadline. The callbacks answered in
+// the meantime are not tracked, the timer then fires early and is armed again
+// for the remaining ones.
+void RuntimeIPCClient::ArmExpiryTimer(Clock::time_point deadline) {
+  if (expiry_timer_) {
+    if (expiry_deadline_ <= deadline)
+      return;
+    ecore_timer_del(expiry_timer_);
+  }
+
+  double delay = std::chrono::duration_cast<std::chrono::duration<double> >(
+      deadline - Clock::now()).count();
+  expiry_deadline_ = deadline;
+  expiry_timer_ = ecore_timer_add(delay > 0 ? delay : 0, [](void* data) {
+    RuntimeIPCClient* self = static_cast<RuntimeIPCClient*>(data);
+    self->expiry_timer_ = NULL;
+    self->RunExpiredCallbacks();
+    return EINA_FALSE;
+  }, this);
+}
+
 }  // namespace extensions
@@ -18,12 +18,15 @@
 #define XWALK_EXTENSIONS_RENDERER_RUNTIME_IPC_CLIENT_H_
 
 #include <v8/v8.h>
+#include <Ecore.h>
 #include <EWebKit.h>
 #include <EWebKit_internal.h>
 
+#include <chrono>
 #include <functional>
 #include <map>
 #include <string>
+#include <vector>
 
 namespace extensions {
 
@@ -42,6 +45,11 @@ class RuntimeIPCClient {
 
   typedef std::function<void(const std::string& type,
                              const std::string& value)> ReplyCallback;
+  typedef std::function<void()> TimeoutCallback;
+
+  // Replies to the asynchronous messages are waited for without a deadline
+  // by default.
+  static const int kDefaultAsyncMessageTimeout = 0;
 
   static RuntimeIPCClient* GetInstance();
 
@@ -77,14 +85,31 @@ class RuntimeIPCClient {
                               const std::string& ref_id,
                               const std::string& value);
 
+  // |source| names the sender, e.g. the extension, in the reports of the
+  // SyncMessageWatchdog.
+  std::string SendSyncMessage(v8::Handle<v8::Context> context,
+                              const std::string& type,
+                              const std::string& id,
+                              const std::string& ref_id,
+                              const std::string& value,
+                              const std::string& source);
+
   // Send message to BrowserProcess asynchronous,
   // reply message will be passed to callback function.
+  // If |timeout_ms| is not 0 and no reply arrives within |timeout_ms|
+  // milliseconds, the callback is dropped and |on_timeout| is called instead.
   void SendAsyncMessage(v8::Handle<v8::Context> context,
                         const std::string& type, const std::string& value,
-                        ReplyCallback callback);
+                        ReplyCallback callback,
+                        int timeout_ms = kDefaultAsyncMessageTimeout,
+                        TimeoutCallback on_timeout = TimeoutCallback());
 
   void HandleMessageFromRuntime(const Ewk_IPC_Wrt_Message_Data* msg);
 
+  // Drops the callbacks waiting for a reply in |context|, when it is
+  // released. Neither the reply nor the timeout callbacks are called.
+  void CancelPendingMessages(v8::Handle<v8::Context> context);
+
   int GetRoutingId(v8::Handle<v8::Context> context);
 
   void SetRoutingId(v8::Handle<v8::Context> context, int routing_id);
@@ -92,7 +117,34 @@ class RuntimeIPCClient {
  private:
   RuntimeIPCClient();
 
-  std::map<std::string, ReplyCallback> callbacks_;
+  typedef std::chrono::steady_clock Clock;
+
+  // |owner| identifies the context which sent the message. |deadline| is
+  // Clock::time_point::max() if the message has none.
+  struct PendingCallback {
+    ReplyCallback callback;
+    TimeoutCallback on_timeout;
+    Clock::time_point deadline;
+    const void* owner;
+  };
+
+  static const void* GetOwner(v8::Handle<v8::Context> context);
+
+  // Calls the timeout callbacks of the messages whose deadline has passed,
+  // then arms |expiry_timer_| for the next deadline.
+  void RunExpiredCallbacks();
+  void ArmExpiryTimer(Clock::time_point deadline);
+
+  std::map<std::string, PendingCallback> callbacks_;
+
+  // Fires at |expiry_deadline_|, the earliest deadline of |callbacks_| when
+  // it was armed. NULL if no message has a deadline.
+  Ecore_Timer* expiry_timer_;
+  Clock::time_point expiry_deadline_;
+
+  // Correlation ids of the asynchronous messages. The replies are routed
+  // back to this process, so the ids only have to be unique in it.
+  unsigned int next_message_id_;
 };
 
 }  // namespace extensions
@@ -0,0 +1,153 @@
+// Copyright (c) 2015 Samsung Electronics Co., Ltd. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "extensions/renderer/sync_message_watchdog.h"
+
+#include <sstream>
+
+#include "common/logger.h"
+
+namespace extensions {
+
+namespace {
+
+// A synchronous message blocking for longer than this is reported.
+const int kStallThresholdMs = 1000;
+
+// How often the in-flight messages are checked.
+const int kCheckIntervalMs = 250;
+
+// The histogram of a source and type is logged every this many messages.
+const unsigned int kHistogramLogInterval = 256;
+
+int BucketOf(int64_t latency_ms, int bucket_count) {
+  int bucket = 0;
+  while (latency_ms > 0 && bucket < bucket_count - 1) {
+    latency_ms >>= 1;
+    ++bucket;
+  }
+  return bucket;
+}
+
+}  // namespace
+
+SyncMessageWatchdog::Scope::Scope(const std::string& source,
+                                  const std::string& type)
+    : token_(SyncMessageWatchdog::GetInstance()->Begin(source, type)) {
+}
+
+SyncMessageWatchdog::Scope::~Scope() {
+  SyncMessageWatchdog::GetInstance()->End(token_);
+}
+
+SyncMessageWatchdog::Histogram::Histogram()
+    : count(0), max_ms(0) {
+  for (int i = 0; i < kBucketCount; ++i)
+    buckets[i] = 0;
+}
+
+// static
+SyncMessageWatchdog* SyncMessageWatchdog::GetInstance() {
+  // Never destroyed, the thread is not joined from a static destructor.
+  static SyncMessageWatchdog* self = new SyncMessageWatchdog;
+  return self;
+}
+
+SyncMessageWatchdog::SyncMessageWatchdog()
+    : next_token_(0),
+      quit_(false) {
+}
+
+void SyncMessageWatchdog::Stop() {
+  if (!thread_.joinable())
+    return;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    quit_ = true;
+  }
+  wakeup_.notify_one();
+  thread_.join();
+  quit_ = false;
+}
+
+int SyncMessageWatchdog::Begin(const std::string& source,
+                               const std::string& type) {
+  if (!thread_.joinable())
+    thread_ = std::thread(&SyncMessageWatchdog::Run, this);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  int token = ++next_token_;
+  InFlight& message = in_flight_[token];
+  message.key = source.empty() ? type : source + " " + type;
+  message.start = Clock::now();
+  message.reported = false;
+  return token;
+}
+
+void SyncMessageWatchdog::End(int token) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = in_flight_.find(token);
+  if (it == in_flight_.end())
+    return;
+
+  int64_t latency_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+      Clock::now() - it->second.start).count();
+  if (it->second.reported) {
+    LOGGER(WARN) << "Sync message [" << it->second.key
+                 << "] unblocked after " << latency_ms << "ms";
+  }
+  Record(it->second.key, latency_ms);
+  in_flight_.erase(it);
+}
+
+void SyncMessageWatchdog::Run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!quit_) {
+    wakeup_.wait_for(lock, std::chrono::milliseconds(kCheckIntervalMs));
+    Clock::time_point now = Clock::now();
+    for (auto it = in_flight_.begin(); it != in_flight_.end(); ++it) {
+      InFlight& message = it->second;
+      if (message.reported)
+        continue;
+      int64_t blocked_ms =
+          std::chrono::duration_cast<std::chrono::milliseconds>(
+              now - message.start).count();
+      if (blocked_ms >= kStallThresholdMs) {
+        LOGGER(ERROR) << "Renderer blocked by sync message ["
+                      << message.key << "] for " << blocked_ms << "ms";
+        message.reported = true;
+      }
+    }
+  }
+}
+
+void SyncMessageWatchdog::Record(const std::string& key, int64_t latency_ms) {
+  Histogram& histogram = histograms_[key];
+  histogram.buckets[BucketOf(latency_ms, kBucketCount)]++;
+  histogram.count++;
+  if (latency_ms > histogram.max_ms)
+    histogram.max_ms = latency_ms;
+  if (histogram.count % kHistogramLogInterval == 0)
+    LogHistogram(key, histogram);
+}
+
+// static
+void SyncMessageWatchdog::LogHistogram(const std::string& key,
+                                       const Histogram& histogram) {
+  std::ostringstream buckets;
+  for (int i = 0; i < kBucketCount; ++i) {
+    if (!histogram.buckets[i])
+      continue;
+    if (i == kBucketCount - 1)
+      buckets << " >=" << (1 << (i - 1));
+    else
+      buckets << " <" << (1 << i);
+    buckets << "ms:" << histogram.buckets[i];
+  }
+  LOGGER(INFO) << "Sync message latency [" << key << "] count: "
+               << histogram.count << ", max: " << histogram.max_ms << "ms,"
+               << buckets.str();
+}
+
+}  // namespace extensions
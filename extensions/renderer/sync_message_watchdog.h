@@ -0,0 +1,80 @@
+// Copyright (c) 2015 Samsung Electronics Co., Ltd. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef XWALK_EXTENSIONS_RENDERER_SYNC_MESSAGE_WATCHDOG_H_
+#define XWALK_EXTENSIONS_RENDERER_SYNC_MESSAGE_WATCHDOG_H_
+
+#include <stdint.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace extensions {
+
+// Keeps track of the synchronous messages the renderer is blocked on. A
+// background thread reports the ones stalling for too long, naming their
+// source (e.g. the extension) and type, and the latency of each source and
+// type is collected in a histogram, logged periodically. The thread is
+// started by the first message and runs until Stop() is called.
+class SyncMessageWatchdog {
+ public:
+  // Marks a synchronous message as in flight for the lifetime of the scope.
+  class Scope {
+   public:
+    Scope(const std::string& source, const std::string& type);
+    ~Scope();
+   private:
+    int token_;
+  };
+
+  static SyncMessageWatchdog* GetInstance();
+
+  int Begin(const std::string& source, const std::string& type);
+  void End(int token);
+
+  // Joins the background thread, e.g. when the last page of the process is
+  // released. It is started again by the next message.
+  void Stop();
+
+ private:
+  typedef std::chrono::steady_clock Clock;
+
+  // Latencies in milliseconds, by powers of two: [0, 1), [1, 2), [2, 4), ...
+  // The last bucket holds everything from 2^(kBucketCount - 2) ms on.
+  static const int kBucketCount = 14;
+  struct Histogram {
+    Histogram();
+    unsigned int buckets[kBucketCount];
+    unsigned int count;
+    int64_t max_ms;
+  };
+
+  struct InFlight {
+    std::string key;
+    Clock::time_point start;
+    bool reported;
+  };
+
+  SyncMessageWatchdog();
+
+  void Run();
+  void Record(const std::string& key, int64_t latency_ms);
+  static void LogHistogram(const std::string& key, const Histogram& histogram);
+
+  std::mutex mutex_;
+  std::condition_variable wakeup_;
+  std::map<int, InFlight> in_flight_;
+  std::map<std::string, Histogram> histograms_;
+  int next_token_;
+  bool quit_;
+  std::thread thread_;
+};
+
+}  // namespace extensions
+
+#endif  // XWALK_EXTENSIONS_RENDERER_SYNC_MESSAGE_WATCHDOG_H_
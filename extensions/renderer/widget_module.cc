@@ -19,6 +19,8 @@
 #include <v8/v8.h>
 
 #include <algorithm>
+#include <cstring>
+#include <set>
 #include <vector>
 
 #include "common/app_db.h"
@@ -96,6 +98,19 @@ v8::Handle<v8::Object> MakeException(int code,
   return handle_scope.Escape(error);
 }
 
+// A read only preference can't be changed, any other change fails if it
+// couldn't be written to the database.
+v8::Handle<v8::Value> ThrowModificationError(WidgetPreferenceDB* widget,
+                                             const std::string& key) {
+  v8::Isolate* isolate = v8::Isolate::GetCurrent();
+  if (widget->IsReadOnly(key)) {
+    return isolate->ThrowException(MakeException(
+        7, "NoModificationAllowedError", "Read only data"));
+  }
+  return isolate->ThrowException(MakeException(
+      22, "QuotaExceededError", "Fail to write the preference"));
+}
+
 void KeyFunction(const v8::FunctionCallbackInfo<v8::Value>& info) {
   v8::Isolate* isolate = v8::Isolate::GetCurrent();
   int idx = info[0]->ToInt32()->Value();
@@ -140,8 +155,7 @@ void SetItemFunction(const v8::FunctionCallbackInfo<v8::Value>& info) {
                   oldvalue,
                   info[1]);
   } else {
-    info.GetReturnValue().Set(isolate->ThrowException(MakeException(
-        7, "NoModificationAllowedError", "Read only data")));
+    info.GetReturnValue().Set(ThrowModificationError(widget, key));
   }
 }
 
@@ -166,8 +180,7 @@ void RemoveItemFunction(const v8::FunctionCallbackInfo<v8::Value>& info) {
                   oldvalue,
                   v8::Null(isolate));
   } else {
-    info.GetReturnValue().Set(isolate->ThrowException(MakeException(
-        7, "NoModificationAllowedError", "Read only data")));
+    info.GetReturnValue().Set(ThrowModificationError(widget, key));
   }
 }
 
@@ -368,7 +381,8 @@ WidgetPreferenceDB* WidgetPreferenceDB::GetInstance() {
 
 WidgetPreferenceDB::WidgetPreferenceDB()
     : appdata_(nullptr),
-      locale_manager_(nullptr) {
+      locale_manager_(nullptr),
+      loaded_(false) {
 }
 WidgetPreferenceDB::~WidgetPreferenceDB() {
 }
@@ -381,6 +395,8 @@ void WidgetPreferenceDB::Initialize(
 }
 
 void WidgetPreferenceDB::InitializeDB() {
+  if (loaded_)
+    return;
   common::AppDB* db = common::AppDB::GetInstance();
   if (db->HasKey(kDBPrivateSection, kDbInitedCheckKey)) {
     return;
@@ -391,6 +407,16 @@ void WidgetPreferenceDB::InitializeDB() {
 
   auto& preferences = appdata_->widget_info()->preferences();
 
+  // Values which are already stored, e.g. migrated from an older runtime,
+  // are kept.
+  std::set<std::string> keys;
+  db->ForEach(kDBPublicSection, std::string(), 0,
+              [&keys](const std::string& key, const std::string&) {
+    keys.insert(key);
+    return true;
+  });
+
+  common::AppDB::Batch batch;
   for (const auto& pref : preferences) {
     if (pref->Name().empty())
       continue;
@@ -402,7 +428,7 @@ void WidgetPreferenceDB::InitializeDB() {
       key.resize(kKeyLengthLimit);
     }
 
-    if (db->HasKey(kDBPublicSection, key))
+    if (!keys.insert(key).second)
       continue;
 
     // check size limit
@@ -410,87 +436,193 @@ void WidgetPreferenceDB::InitializeDB() {
       value.resize(kValueLengthLimit);
     }
 
-    db->Set(kDBPublicSection,
-            key,
-            value);
+    batch.Set(kDBPublicSection,
+              key,
+              value);
     if (pref->ReadOnly()) {
-      db->Set(kDBPrivateSection,
-              kReadOnlyPrefix + key, "true");
+      batch.Set(kDBPrivateSection,
+                kReadOnlyPrefix + key, "true");
     }
   }
-  db->Set(kDBPrivateSection, kDbInitedCheckKey, "true");
+  batch.Set(kDBPrivateSection, kDbInitedCheckKey, "true");
+  if (!db->Apply(batch))
+    LOGGER(ERROR) << "Fail to store the preferences of config.xml";
 }
 
-int WidgetPreferenceDB::Length() {
+// A cache which failed to load is dropped, and loaded again on the next
+// access.
+void WidgetPreferenceDB::EnsureLoaded() {
+  if (loaded_)
+    return;
+
   common::AppDB* db = common::AppDB::GetInstance();
-  std::list<std::string> list;
-  db->GetKeys(kDBPublicSection, &list);
-  return list.size();
+  ResetCache();
+  bool read = db->ForEach(kDBPublicSection, std::string(), 0,
+                          [this](const std::string& key,
+                                 const std::string& value) {
+    AddToCache(key, value, false);
+    return true;
+  });
+
+  const size_t prefix_length = strlen(kReadOnlyPrefix);
+  read = read && db->ForEach(kDBPrivateSection, kReadOnlyPrefix, 0,
+                             [this, prefix_length](const std::string& key,
+                                                   const std::string&) {
+    auto it = items_.find(key.substr(prefix_length));
+    if (it != items_.end())
+      it->second.read_only = true;
+    return true;
+  });
+  if (!read) {
+    LOGGER(ERROR) << "Fail to read the preferences";
+    ResetCache();
+    return;
+  }
+  loaded_ = true;
 }
 
-bool WidgetPreferenceDB::Key(int idx, std::string* key) {
-  common::AppDB* db = common::AppDB::GetInstance();
-  std::list<std::string> list;
-  db->GetKeys(kDBPublicSection, &list);
-
-  auto it = list.begin();
-  for ( ; it != list.end() && idx >= 0; ++it) {
-    if (idx == 0) {
-      *key = *it;
-      return true;
-    }
-    idx--;
+void WidgetPreferenceDB::ResetCache() {
+  items_.clear();
+  keys_.clear();
+  loaded_ = false;
+}
+
+void WidgetPreferenceDB::AddToCache(const std::string& key,
+                                    const std::string& value,
+                                    bool read_only) {
+  auto it = items_.find(key);
+  if (it != items_.end()) {
+    it->second.value = value;
+    return;
+  }
+  Item item = { value, keys_.size(), read_only };
+  items_[key] = item;
+  keys_.push_back(key);
+}
+
+// The last key takes the place of the removed one.
+void WidgetPreferenceDB::RemoveFromCache(const std::string& key) {
+  auto it = items_.find(key);
+  if (it == items_.end())
+    return;
+  size_t index = it->second.index;
+  if (index != keys_.size() - 1) {
+    keys_[index] = keys_.back();
+    items_[keys_[index]].index = index;
   }
-  return false;
+  keys_.pop_back();
+  items_.erase(it);
+}
+
+int WidgetPreferenceDB::Length() {
+  EnsureLoaded();
+  return keys_.size();
+}
+
+bool WidgetPreferenceDB::Key(int idx, std::string* key) {
+  EnsureLoaded();
+  if (idx < 0 || static_cast<size_t>(idx) >= keys_.size())
+    return false;
+  *key = keys_[idx];
+  return true;
 }
 
 bool WidgetPreferenceDB::GetItem(const std::string& key, std::string* value) {
-  common::AppDB* db = common::AppDB::GetInstance();
-  if (!db->HasKey(kDBPublicSection, key))
+  EnsureLoaded();
+  auto it = items_.find(key);
+  if (it == items_.end())
     return false;
-  *value = db->Get(kDBPublicSection, key);
+  *value = it->second.value;
   return true;
 }
 
 bool WidgetPreferenceDB::SetItem(const std::string& key,
                                  const std::string& value) {
+  EnsureLoaded();
+  auto it = items_.find(key);
+  if (it != items_.end() && it->second.read_only)
+    return false;
+  // The cache is only changed once the value is written.
+  common::AppDB::Batch batch;
+  batch.Set(kDBPublicSection, key, value);
   common::AppDB* db = common::AppDB::GetInstance();
-  if (db->HasKey(kDBPrivateSection, kReadOnlyPrefix + key))
+  if (!db->Apply(batch)) {
+    LOGGER(ERROR) << "Fail to set the preference " << key;
     return false;
-  db->Set(kDBPublicSection, key, value);
+  }
+  AddToCache(key, value, false);
   return true;
 }
 
 bool WidgetPreferenceDB::RemoveItem(const std::string& key) {
-  common::AppDB* db = common::AppDB::GetInstance();
-  if (!db->HasKey(kDBPublicSection, key))
+  EnsureLoaded();
+  auto it = items_.find(key);
+  if (it == items_.end())
     return false;
-  if (db->HasKey(kDBPrivateSection, kReadOnlyPrefix + key))
+  if (it->second.read_only)
     return false;
-  db->Remove(kDBPublicSection, key);
+  common::AppDB::Batch batch;
+  batch.Remove(kDBPublicSection, key);
+  common::AppDB* db = common::AppDB::GetInstance();
+  if (!db->Apply(batch)) {
+    LOGGER(ERROR) << "Fail to remove the preference " << key;
+    return false;
+  }
+  RemoveFromCache(key);
   return true;
 }
 
 bool WidgetPreferenceDB::HasItem(const std::string& key) {
-  common::AppDB* db = common::AppDB::GetInstance();
-  return db->HasKey(kDBPublicSection, key);
+  EnsureLoaded();
+  return items_.find(key) != items_.end();
+}
+
+bool WidgetPreferenceDB::IsReadOnly(const std::string& key) {
+  EnsureLoaded();
+  auto it = items_.find(key);
+  return it != items_.end() && it->second.read_only;
 }
 
+// The read-only keys are read from the db rather than from the cache, so
+// that they are kept even if the cache could not be loaded.
 void WidgetPreferenceDB::Clear() {
   common::AppDB* db = common::AppDB::GetInstance();
-  std::list<std::string> list;
-  db->GetKeys(kDBPublicSection, &list);
-  auto it = list.begin();
-  for ( ; it != list.end(); ++it) {
-    if (db->HasKey(kDBPrivateSection, kReadOnlyPrefix + *it))
-      continue;
-    db->Remove(kDBPublicSection, *it);
+  std::set<std::string> read_only_keys;
+  const size_t prefix_length = strlen(kReadOnlyPrefix);
+  if (!db->ForEach(kDBPrivateSection, kReadOnlyPrefix, 0,
+                   [&read_only_keys, prefix_length](const std::string& key,
+                                                    const std::string&) {
+    read_only_keys.insert(key.substr(prefix_length));
+    return true;
+  })) {
+    LOGGER(ERROR) << "Fail to read the read-only preferences";
+    return;
+  }
+
+  common::AppDB::Batch batch;
+  batch.RemoveSection(kDBPublicSection, read_only_keys);
+  if (!db->Apply(batch)) {
+    LOGGER(ERROR) << "Fail to clear the preferences";
+    return;
+  }
+
+  if (!loaded_)
+    return;
+  std::vector<std::string> kept_keys;
+  for (const auto& key : keys_) {
+    if (items_[key].read_only)
+      kept_keys.push_back(key);
+    else
+      items_.erase(key);
   }
+  keys_.swap(kept_keys);
+  for (size_t i = 0; i < keys_.size(); ++i)
+    items_[keys_[i]].index = i;
 }
 
 void WidgetPreferenceDB::GetKeys(std::list<std::string>* keys) {
-  common::AppDB* db = common::AppDB::GetInstance();
-  db->GetKeys(kDBPublicSection, keys);
+  EnsureLoaded();
+  keys->insert(keys->end(), keys_.begin(), keys_.end());
 }
 
 std::string WidgetPreferenceDB::author() {
@@ -19,6 +19,8 @@
 
 #include <list>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "common/application_data.h"
 #include "common/locale_manager.h"
@@ -49,6 +51,7 @@ class WidgetPreferenceDB {
   bool SetItem(const std::string& key, const std::string& value);
   bool RemoveItem(const std::string& key);
   bool HasItem(const std::string& key);
+  bool IsReadOnly(const std::string& key);
   void Clear();
   void GetKeys(std::list<std::string>* keys);
 
@@ -66,8 +69,28 @@ class WidgetPreferenceDB {
  private:
   WidgetPreferenceDB();
   virtual ~WidgetPreferenceDB();
+
+  // The preferences are only changed through this object, so they are read
+  // from the AppDB once, and every change is written through to it.
+  void EnsureLoaded();
+  void ResetCache();
+  void AddToCache(const std::string& key, const std::string& value,
+                  bool read_only);
+  void RemoveFromCache(const std::string& key);
+
+  struct Item {
+    std::string value;
+    size_t index;  // Position of the key in |keys_|.
+    bool read_only;
+  };
+
   const common::ApplicationData* appdata_;
   common::LocaleManager* locale_manager_;
+
+  bool loaded_;
+  std::unordered_map<std::string, Item> items_;
+  // The keys in the order of key(), which changes when a key is removed.
+  std::vector<std::string> keys_;
 };
 
 }  // namespace extensions
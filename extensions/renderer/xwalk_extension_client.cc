@@ -6,11 +6,14 @@
 #include "extensions/renderer/xwalk_extension_client.h"
 
 #include <Ecore.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <v8/v8.h>
 #include <json/json.h>
 
 #include <string>
+#include <vector>
 
 #include "common/logger.h"
 #include "common/profiler.h"
@@ -28,6 +31,26 @@ namespace {
     std::string instance_id = server->CreateInstance(extension_name);
     return static_cast<void*>(new std::string(instance_id));
   }
+
+  // Splits the value of kMethodPostMessagesToJS, in which every message is
+  // prefixed by its length in bytes and a colon.
+  bool SplitMessages(Eina_Stringshare* msg,
+                     std::vector<XWalkExtensionClient::Message>* msgs) {
+    const char* pos = msg;
+    const char* end = msg + eina_stringshare_strlen(msg);
+    while (pos < end) {
+      char* data = NULL;
+      size_t length = strtoul(pos, &data, 10);
+      if (data == pos || *data != ':' ||
+          length > static_cast<size_t>(end - data - 1))
+        return false;
+      ++data;
+      XWalkExtensionClient::Message item = { msg, data, length };
+      msgs->push_back(item);
+      pos = data + length;
+    }
+    return true;
+  }
 }  // namespace
 
 XWalkExtensionClient::XWalkExtensionClient() {
@@ -94,14 +117,40 @@ void XWalkExtensionClient::PostMessageToNative(
 }
 
 std::string XWalkExtensionClient::SendSyncMessageToNative(
-    v8::Handle<v8::Context> context,
+    v8::Handle<v8::Context> context, const std::string& extension_name,
     const std::string& instance_id, const std::string& msg) {
   RuntimeIPCClient* ipc = RuntimeIPCClient::GetInstance();
   std::string reply =
-      ipc->SendSyncMessage(context, kMethodSendSyncMessage, instance_id, msg);
+      ipc->SendSyncMessage(context, kMethodSendSyncMessage, instance_id, "",
+                           msg, extension_name);
   return reply;
 }
 
+void XWalkExtensionClient::OpenStream(
+    v8::Handle<v8::Context> context, const std::string& instance_id,
+    int stream, int credit, const std::string& msg) {
+  RuntimeIPCClient* ipc = RuntimeIPCClient::GetInstance();
+  ipc->SendMessage(context, kMethodOpenStream, instance_id,
+                   std::to_string(stream),
+                   std::to_string(credit) + ":" + msg);
+}
+
+void XWalkExtensionClient::PullStream(
+    v8::Handle<v8::Context> context, const std::string& instance_id,
+    int stream, int credit) {
+  RuntimeIPCClient* ipc = RuntimeIPCClient::GetInstance();
+  ipc->SendMessage(context, kMethodPullStream, instance_id,
+                   std::to_string(stream), std::to_string(credit));
+}
+
+void XWalkExtensionClient::CancelStream(
+    v8::Handle<v8::Context> context, const std::string& instance_id,
+    int stream) {
+  RuntimeIPCClient* ipc = RuntimeIPCClient::GetInstance();
+  ipc->SendMessage(context, kMethodCancelStream, instance_id,
+                   std::to_string(stream), "");
+}
+
 std::string XWalkExtensionClient::GetAPIScript(
     v8::Handle<v8::Context> context,
     const std::string& extension_name) {
@@ -110,17 +159,50 @@ std::string XWalkExtensionClient::GetAPIScript(
 }
 
 void XWalkExtensionClient::OnReceivedIPCMessage(
-    const std::string& instance_id, const std::string& msg) {
+    const char* type, const std::string& instance_id, Eina_Stringshare* msg) {
   auto it = handlers_.find(instance_id);
   if (it == handlers_.end()) {
     LOGGER(WARN) << "Failed to post the message. Invalid instance id.";
     return;
   }
 
-  if (!it->second)
+  InstanceHandler* handler = it->second;
+  if (!handler)
     return;
 
-  it->second->HandleMessageFromNative(msg);
+  // The stream events are "<stream>:<chunk or error>".
+  if (!strcmp(type, kMethodStreamChunkToJS) ||
+      !strcmp(type, kMethodStreamEndToJS)) {
+    char* data = NULL;
+    int stream = strtol(msg, &data, 10);
+    if (data == msg || *data != ':') {
+      LOGGER(ERROR) << "Malformed stream message for " << instance_id;
+      return;
+    }
+    ++data;
+    if (!strcmp(type, kMethodStreamEndToJS)) {
+      handler->HandleStreamEndFromNative(stream, std::string(data));
+    } else {
+      size_t length = eina_stringshare_strlen(msg) - (data - msg);
+      Message chunk = { msg, data, length };
+      handler->HandleStreamChunkFromNative(stream, chunk);
+    }
+    return;
+  }
+
+  std::vector<Message> msgs;
+  if (!strcmp(type, kMethodPostMessagesToJS)) {
+    if (!SplitMessages(msg, &msgs)) {
+      LOGGER(ERROR) << "Malformed batch of messages for " << instance_id;
+      return;
+    }
+  } else {
+    size_t length = eina_stringshare_strlen(msg);
+    Message item = { msg, msg, length };
+    msgs.push_back(item);
+  }
+
+  handler->HandleMessagesFromNative(msgs);
 }
 
 void XWalkExtensionClient::LoadUserExtensions(const std::string app_path) {
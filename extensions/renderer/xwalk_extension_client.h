@@ -6,6 +6,7 @@
 #ifndef XWALK_EXTENSIONS_RENDERER_XWALK_EXTENSION_CLIENT_H_
 #define XWALK_EXTENSIONS_RENDERER_XWALK_EXTENSION_CLIENT_H_
 
+#include <Eina.h>
 #include <v8/v8.h>
 
 #include <map>
@@ -19,8 +20,25 @@ namespace extensions {
 
 class XWalkExtensionClient {
  public:
+  // A message posted by the native side of an extension. |data| points into
+  // |shared|, the string received through IPC, so a handler may keep its own
+  // reference to it instead of copying the message.
+  struct Message {
+    Eina_Stringshare* shared;
+    const char* data;
+    size_t length;
+  };
+
   struct InstanceHandler {
-    virtual void HandleMessageFromNative(const std::string& msg) = 0;
+    // |msgs| are all the messages received for the instance by a single IPC
+    // message, in the order they were posted.
+    virtual void HandleMessagesFromNative(const std::vector<Message>& msgs) = 0;
+    // A chunk written to |stream| opened by the handler.
+    virtual void HandleStreamChunkFromNative(int stream,
+                                             const Message& chunk) = 0;
+    // |stream| has ended, it failed if |error| is not empty.
+    virtual void HandleStreamEndFromNative(int stream,
+                                           const std::string& error) = 0;
    protected:
     ~InstanceHandler() {}
   };
@@ -39,15 +57,30 @@ class XWalkExtensionClient {
   void PostMessageToNative(v8::Handle<v8::Context> context,
                            const std::string& instance_id,
                            const std::string& msg);
+  // |extension_name| is reported if the message stalls.
   std::string SendSyncMessageToNative(v8::Handle<v8::Context> context,
+                                      const std::string& extension_name,
                                       const std::string& instance_id,
                                       const std::string& msg);
 
+  // Streams of chunks replied by the native side of the extension, see
+  // XW_Extension_Stream.h. |credit| is the number of chunks it may send.
+  void OpenStream(v8::Handle<v8::Context> context,
+                  const std::string& instance_id,
+                  int stream, int credit, const std::string& msg);
+  void PullStream(v8::Handle<v8::Context> context,
+                  const std::string& instance_id,
+                  int stream, int credit);
+  void CancelStream(v8::Handle<v8::Context> context,
+                    const std::string& instance_id,
+                    int stream);
+
   std::string GetAPIScript(v8::Handle<v8::Context> context,
                            const std::string& extension_name);
 
-  void OnReceivedIPCMessage(const std::string& instance_id,
-                            const std::string& msg);
+  void OnReceivedIPCMessage(const char* type,
+                            const std::string& instance_id,
+                            Eina_Stringshare* msg);
   void LoadUserExtensions(const std::string app_path);
 
   struct ExtensionCodePoints {
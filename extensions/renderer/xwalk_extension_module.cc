@@ -27,13 +27,133 @@ namespace {
 // pointer back to kXWalkExtensionModule.
 const char* kXWalkExtensionModule = "kXWalkExtensionModule";
 
+// Number of chunks a stream buffers by default, see kCreateStreamCode.
+const int kDefaultStreamHighWaterMark = 16;
+
+// Creates the JS side of a stream. The native side of the extension may send
+// as many chunks as the credit it was given, the credit is replenished once
+// the chunks buffered and in flight are down to half |highWaterMark|.
+// Returns the stream exposed to the extension JS code, and the push() and
+// end() functions used to feed it.
+const char* kCreateStreamCode =
+    "(function(id, highWaterMark, pull, cancel) {"
+    "  var queue = [];"
+    "  var readers = [];"
+    "  var done = false;"
+    "  var error = null;"
+    "  var credit = highWaterMark;"
+    "  function settle() {"
+    "    while (readers.length && (queue.length || done)) {"
+    "      var reader = readers.shift();"
+    "      if (queue.length)"
+    "        reader.resolve({ value: queue.shift(), done: false });"
+    "      else if (error)"
+    "        reader.reject(error);"
+    "      else"
+    "        reader.resolve({ value: undefined, done: true });"
+    "    }"
+    "    if (!done && (credit + queue.length) * 2 <= highWaterMark) {"
+    "      var more = highWaterMark - credit - queue.length;"
+    "      credit += more;"
+    "      pull(id, more);"
+    "    }"
+    "  }"
+    "  var stream = {"
+    "    read: function() {"
+    "      return new Promise(function(resolve, reject) {"
+    "        readers.push({ resolve: resolve, reject: reject });"
+    "        settle();"
+    "      });"
+    "    },"
+    "    cancel: function() {"
+    "      if (done) return;"
+    "      done = true;"
+    "      queue = [];"
+    "      cancel(id);"
+    "      settle();"
+    "    }"
+    "  };"
+    "  if (typeof Symbol === 'function' && Symbol.asyncIterator) {"
+    "    stream[Symbol.asyncIterator] = function() {"
+    "      return {"
+    "        next: stream.read,"
+    "        return: function() {"
+    "          stream.cancel();"
+    "          return Promise.resolve({ value: undefined, done: true });"
+    "        }"
+    "      };"
+    "    };"
+    "  }"
+    "  return {"
+    "    stream: stream,"
+    "    push: function(chunk) {"
+    "      if (done) return;"
+    "      credit--;"
+    "      queue.push(chunk);"
+    "      settle();"
+    "    },"
+    "    end: function(message) {"
+    "      if (done) return;"
+    "      done = true;"
+    "      if (message) error = new Error(message);"
+    "      settle();"
+    "    }"
+    "  };"
+    "})";
+
+// Messages from this size on are handed to V8 without being copied.
+const size_t kMinExternalMessageLength = 1024;
+
+// Exposes a message received through IPC to V8 without copying it. The
+// resource holds a reference to the shared string the message is part of
+// until the JS string is garbage collected.
+class StringshareResource : public v8::String::ExternalOneByteStringResource {
+ public:
+  explicit StringshareResource(const XWalkExtensionClient::Message& msg)
+      : shared_(eina_stringshare_ref(msg.shared)),
+        data_(msg.data),
+        length_(msg.length) {
+  }
+  ~StringshareResource() override {
+    eina_stringshare_del(shared_);
+  }
+
+  const char* data() const override { return data_; }
+  size_t length() const override { return length_; }
+
+ private:
+  Eina_Stringshare* shared_;
+  const char* data_;
+  size_t length_;
+};
+
+// One-byte external strings are Latin-1, so only the messages made of ASCII
+// characters can be shared as is, the others are decoded from UTF-8.
+bool IsASCII(const char* str, size_t length) {
+  for (size_t i = 0; i < length; ++i) {
+    if (static_cast<unsigned char>(str[i]) >= 0x80)
+      return false;
+  }
+  return true;
+}
+
+v8::Handle<v8::String> MessageToV8String(
+    v8::Isolate* isolate, const XWalkExtensionClient::Message& msg) {
+  if (msg.length >= kMinExternalMessageLength &&
+      IsASCII(msg.data, msg.length))
+    return v8::String::NewExternal(isolate, new StringshareResource(msg));
+  return v8::String::NewFromUtf8(
+      isolate, msg.data, v8::String::kNormalString, msg.length);
+}
+
 }  // namespace
 
 XWalkExtensionModule::XWalkExtensionModule(XWalkExtensionClient* client,
                                            XWalkModuleSystem* module_system,
                                            const std::string& extension_name,
                                            const std::string& extension_code)
-    : extension_name_(extension_name),
+    : last_stream_id_(0),
+      extension_name_(extension_name),
       extension_code_(extension_code),
       client_(client),
       module_system_(module_system) {
@@ -58,6 +178,14 @@ XWalkExtensionModule::XWalkExtensionModule(XWalkExtensionClient* client,
       v8::String::NewFromUtf8(isolate, "setMessageListener"),
       v8::FunctionTemplate::New(
           isolate, SetMessageListenerCallback, function_data));
+  object_template->Set(
+      v8::String::NewFromUtf8(isolate, "setBatchMessageListener"),
+      v8::FunctionTemplate::New(
+          isolate, SetBatchMessageListenerCallback, function_data));
+  object_template->Set(
+      v8::String::NewFromUtf8(isolate, "openStream"),
+      v8::FunctionTemplate::New(
+          isolate, OpenStreamCallback, function_data));
   object_template->Set(
       v8::String::NewFromUtf8(isolate, "sendRuntimeMessage"),
       v8::FunctionTemplate::New(
@@ -91,6 +219,13 @@ XWalkExtensionModule::~XWalkExtensionModule() {
   object_template_.Reset();
   function_data_.Reset();
   message_listener_.Reset();
+  batch_message_listener_.Reset();
+  stream_factory_.Reset();
+  for (auto it = streams_.begin(); it != streams_.end(); ++it) {
+    it->second->Reset();
+    delete it->second;
+  }
+  streams_.clear();
 
   if (!instance_id_.empty())
     client_->DestroyInstance(module_system_->GetV8Context(), instance_id_);
@@ -297,8 +432,9 @@ void XWalkExtensionModule::LoadExtensionCode(
   }
 }
 
-void XWalkExtensionModule::HandleMessageFromNative(const std::string& msg) {
-  if (message_listener_.IsEmpty())
+void XWalkExtensionModule::HandleMessagesFromNative(
+    const std::vector<XWalkExtensionClient::Message>& msgs) {
+  if (message_listener_.IsEmpty() && batch_message_listener_.IsEmpty())
     return;
 
   v8::Isolate* isolate = v8::Isolate::GetCurrent();
@@ -306,19 +442,121 @@ void XWalkExtensionModule::HandleMessageFromNative(const std::string& msg) {
   v8::Handle<v8::Context> context = module_system_->GetV8Context();
   v8::Context::Scope context_scope(context);
 
-  v8::Handle<v8::Value> args[] = {
-      v8::String::NewFromUtf8(isolate, msg.c_str()) };
+  v8::TryCatch try_catch;
+  if (!batch_message_listener_.IsEmpty()) {
+    v8::Handle<v8::Array> array = v8::Array::New(isolate, msgs.size());
+    for (size_t i = 0; i < msgs.size(); ++i)
+      array->Set(i, MessageToV8String(isolate, msgs[i]));
+
+    v8::Handle<v8::Value> args[] = { array };
+    v8::Handle<v8::Function> batch_message_listener =
+        v8::Local<v8::Function>::New(isolate, batch_message_listener_);
+    batch_message_listener->Call(context->Global(), 1, args);
+    if (try_catch.HasCaught())
+      LOGGER(ERROR) << "Exception when running batch message listener: "
+                    << ExceptionToString(try_catch);
+    return;
+  }
+
+  for (auto it = msgs.begin(); it != msgs.end(); ++it) {
+    // The listener may be unset by a previous message of the batch.
+    if (message_listener_.IsEmpty())
+      break;
+
+    v8::HandleScope message_scope(isolate);
+    v8::Handle<v8::Value> args[] = { MessageToV8String(isolate, *it) };
+    v8::Handle<v8::Function> message_listener =
+        v8::Local<v8::Function>::New(isolate, message_listener_);
+    message_listener->Call(context->Global(), 1, args);
+    if (try_catch.HasCaught()) {
+      LOGGER(ERROR) << "Exception when running message listener: "
+                    << ExceptionToString(try_catch);
+      try_catch.Reset();
+    }
+  }
+}
+
+void XWalkExtensionModule::HandleStreamChunkFromNative(
+    int stream, const XWalkExtensionClient::Message& chunk) {
+  auto it = streams_.find(stream);
+  if (it == streams_.end())
+    return;
+
+  v8::Isolate* isolate = v8::Isolate::GetCurrent();
+  v8::HandleScope handle_scope(isolate);
+  v8::Handle<v8::Context> context = module_system_->GetV8Context();
+  v8::Context::Scope context_scope(context);
+
+  v8::Handle<v8::Object> controller =
+      v8::Local<v8::Object>::New(isolate, *it->second);
+  v8::Handle<v8::Function> push = v8::Handle<v8::Function>::Cast(
+      controller->Get(v8::String::NewFromUtf8(isolate, "push")));
+  v8::Handle<v8::Value> args[] = { MessageToV8String(isolate, chunk) };
+
+  v8::TryCatch try_catch;
+  push->Call(context->Global(), 1, args);
+  if (try_catch.HasCaught())
+    LOGGER(ERROR) << "Exception when pushing a stream chunk: "
+                  << ExceptionToString(try_catch);
+}
+
+void XWalkExtensionModule::HandleStreamEndFromNative(
+    int stream, const std::string& error) {
+  auto it = streams_.find(stream);
+  if (it == streams_.end())
+    return;
 
-  v8::Handle<v8::Function> message_listener =
-      v8::Local<v8::Function>::New(isolate, message_listener_);
+  v8::Isolate* isolate = v8::Isolate::GetCurrent();
+  v8::HandleScope handle_scope(isolate);
+  v8::Handle<v8::Context> context = module_system_->GetV8Context();
+  v8::Context::Scope context_scope(context);
+
+  v8::Handle<v8::Object> controller =
+      v8::Local<v8::Object>::New(isolate, *it->second);
+  ReleaseStream(stream);
+
+  v8::Handle<v8::Function> end = v8::Handle<v8::Function>::Cast(
+      controller->Get(v8::String::NewFromUtf8(isolate, "end")));
+  v8::Handle<v8::Value> args[] = {
+    error.empty() ?
+        v8::Handle<v8::Value>(v8::Undefined(isolate)) :
+        v8::Handle<v8::Value>(v8::String::NewFromUtf8(isolate, error.c_str()))
+  };
 
   v8::TryCatch try_catch;
-  message_listener->Call(context->Global(), 1, args);
+  end->Call(context->Global(), 1, args);
   if (try_catch.HasCaught())
-    LOGGER(ERROR) << "Exception when running message listener: "
+    LOGGER(ERROR) << "Exception when ending a stream: "
                   << ExceptionToString(try_catch);
 }
 
+v8::Handle<v8::Function> XWalkExtensionModule::GetStreamFactory(
+    v8::Handle<v8::Context> context) {
+  v8::Isolate* isolate = context->GetIsolate();
+  if (!stream_factory_.IsEmpty())
+    return v8::Local<v8::Function>::New(isolate, stream_factory_);
+
+  std::string exception;
+  v8::Handle<v8::Value> result = RunString(kCreateStreamCode, &exception);
+  if (!result->IsFunction()) {
+    LOGGER(ERROR) << "Couldn't load the stream code: " << exception;
+    return v8::Handle<v8::Function>();
+  }
+
+  v8::Handle<v8::Function> factory = v8::Handle<v8::Function>::Cast(result);
+  stream_factory_.Reset(isolate, factory);
+  return factory;
+}
+
+void XWalkExtensionModule::ReleaseStream(int stream) {
+  auto it = streams_.find(stream);
+  if (it == streams_.end())
+    return;
+  it->second->Reset();
+  delete it->second;
+  streams_.erase(it);
+}
+
 // static
 void XWalkExtensionModule::PostMessageCallback(
     const v8::FunctionCallbackInfo<v8::Value>& info) {
@@ -354,6 +592,7 @@ void XWalkExtensionModule::SendSyncMessageCallback(
   std::string reply =
       module->client_->SendSyncMessageToNative(
           module->module_system_->GetV8Context(),
+          module->extension_name_,
           module->instance_id_,
           std::string(*value));
 
@@ -389,6 +628,118 @@ void XWalkExtensionModule::SetMessageListenerCallback(
   result.Set(true);
 }
 
+// static
+void XWalkExtensionModule::SetBatchMessageListenerCallback(
+    const v8::FunctionCallbackInfo<v8::Value>& info) {
+  v8::ReturnValue<v8::Value> result(info.GetReturnValue());
+  XWalkExtensionModule* module = GetExtensionModule(info);
+  if (!module || info.Length() != 1) {
+    result.Set(false);
+    return;
+  }
+
+  if (!info[0]->IsFunction() && !info[0]->IsUndefined()) {
+    LOGGER(ERROR) << "Trying to set batch message listener with invalid value.";
+    result.Set(false);
+    return;
+  }
+
+  v8::Isolate* isolate = info.GetIsolate();
+  if (info[0]->IsUndefined())
+    module->batch_message_listener_.Reset();
+  else
+    module->batch_message_listener_.Reset(isolate, info[0].As<v8::Function>());
+
+  result.Set(true);
+}
+
+// static
+void XWalkExtensionModule::OpenStreamCallback(
+    const v8::FunctionCallbackInfo<v8::Value>& info) {
+  v8::Isolate* isolate = info.GetIsolate();
+  v8::ReturnValue<v8::Value> result(info.GetReturnValue());
+  XWalkExtensionModule* module = GetExtensionModule(info);
+  if (!module || info.Length() < 1 || info.Length() > 2) {
+    result.Set(false);
+    return;
+  }
+
+  v8::String::Utf8Value value(info[0]->ToString());
+  int high_water_mark = kDefaultStreamHighWaterMark;
+  if (info.Length() > 1 && info[1]->IsNumber() && info[1]->Int32Value() > 0)
+    high_water_mark = info[1]->Int32Value();
+
+  v8::Handle<v8::Context> context = module->module_system_->GetV8Context();
+  v8::Handle<v8::Function> factory = module->GetStreamFactory(context);
+  if (factory.IsEmpty()) {
+    result.Set(false);
+    return;
+  }
+
+  v8::Handle<v8::Object> function_data =
+      v8::Local<v8::Object>::New(isolate, module->function_data_);
+  int stream = ++module->last_stream_id_;
+  v8::Handle<v8::Value> args[] = {
+    v8::Integer::New(isolate, stream),
+    v8::Integer::New(isolate, high_water_mark),
+    v8::FunctionTemplate::New(
+        isolate, PullStreamCallback, function_data)->GetFunction(),
+    v8::FunctionTemplate::New(
+        isolate, CancelStreamCallback, function_data)->GetFunction()
+  };
+
+  v8::TryCatch try_catch;
+  v8::Handle<v8::Value> controller =
+      factory->Call(context->Global(), ARRAYSIZE(args), args);
+  if (try_catch.HasCaught() || !controller->IsObject()) {
+    LOGGER(ERROR) << "Exception when creating a stream: "
+                  << ExceptionToString(try_catch);
+    result.Set(false);
+    return;
+  }
+
+  v8::Handle<v8::Object> controller_object = controller.As<v8::Object>();
+  module->streams_[stream] =
+      new v8::Persistent<v8::Object>(isolate, controller_object);
+  module->client_->OpenStream(context, module->instance_id_, stream,
+                              high_water_mark, std::string(*value));
+
+  result.Set(controller_object->Get(v8::String::NewFromUtf8(isolate,
+                                                            "stream")));
+}
+
+// static
+void XWalkExtensionModule::PullStreamCallback(
+    const v8::FunctionCallbackInfo<v8::Value>& info) {
+  XWalkExtensionModule* module = GetExtensionModule(info);
+  if (!module || info.Length() != 2)
+    return;
+
+  int stream = info[0]->Int32Value();
+  if (module->streams_.find(stream) == module->streams_.end())
+    return;
+
+  module->client_->PullStream(module->module_system_->GetV8Context(),
+                              module->instance_id_, stream,
+                              info[1]->Int32Value());
+}
+
+// static
+void XWalkExtensionModule::CancelStreamCallback(
+    const v8::FunctionCallbackInfo<v8::Value>& info) {
+  XWalkExtensionModule* module = GetExtensionModule(info);
+  if (!module || info.Length() != 1)
+    return;
+
+  int stream = info[0]->Int32Value();
+  if (module->streams_.find(stream) == module->streams_.end())
+    return;
+
+  module->ReleaseStream(stream);
+  module->client_->CancelStream(module->module_system_->GetV8Context(),
+                                module->instance_id_, stream);
+}
+
 // static
 void XWalkExtensionModule::SendRuntimeMessageCallback(
     const v8::FunctionCallbackInfo<v8::Value>& info) {
@@ -435,7 +786,8 @@ void XWalkExtensionModule::SendRuntimeSyncMessageCallback(
   RuntimeIPCClient* rc = RuntimeIPCClient::GetInstance();
   std::string reply = rc->SendSyncMessage(
       module->module_system_->GetV8Context(),
-      std::string(*type), data_str);
+      std::string(*type), "", "", data_str,
+      module->extension_name_);
 
   result.Set(v8::String::NewFromUtf8(isolate, reply.c_str()));
 }
@@ -464,14 +816,28 @@ void XWalkExtensionModule::SendRuntimeAsyncMessageCallback(
   }
 
   // callback
-  RuntimeIPCClient::JSCallback* js_callback = NULL;
+  // The callbacks are shared by the reply and the timeout handlers, and are
+  // released along with them if the message is cancelled.
+  std::shared_ptr<RuntimeIPCClient::JSCallback> js_callback;
   if (info.Length() > 2) {
     if (info[2]->IsFunction()) {
       v8::Handle<v8::Function> func = info[2].As<v8::Function>();
-      js_callback = new RuntimeIPCClient::JSCallback(isolate, func);
+      js_callback.reset(new RuntimeIPCClient::JSCallback(isolate, func));
     }
   }
 
+  // timeout in milliseconds, 0 for none, and its callback
+  int timeout_ms = RuntimeIPCClient::kDefaultAsyncMessageTimeout;
+  if (info.Length() > 3 && info[3]->IsNumber() &&
+      info[3]->Int32Value() >= 0) {
+    timeout_ms = info[3]->Int32Value();
+  }
+  std::shared_ptr<RuntimeIPCClient::JSCallback> js_timeout_callback;
+  if (info.Length() > 4 && info[4]->IsFunction()) {
+    v8::Handle<v8::Function> func = info[4].As<v8::Function>();
+    js_timeout_callback.reset(new RuntimeIPCClient::JSCallback(isolate, func));
+  }
+
   auto callback = [js_callback](const std::string& /*type*/,
                      const std::string& value) -> void {
     if (!js_callback) {
@@ -483,12 +849,21 @@ void XWalkExtensionModule::SendRuntimeAsyncMessageCallback(
     v8::Handle<v8::Value> args[] = {
         v8::String::NewFromUtf8(isolate, value.c_str()) };
     js_callback->Call(isolate, args);
-    delete js_callback;
+  };
+
+  auto on_timeout = [js_timeout_callback]() -> void {
+    if (!js_timeout_callback)
+      return;
+    v8::Isolate* isolate = v8::Isolate::GetCurrent();
+    v8::HandleScope handle_scope(isolate);
+    v8::Handle<v8::Value> args[] = { v8::Undefined(isolate) };
+    js_timeout_callback->Call(isolate, args);
   };
 
   RuntimeIPCClient* rc = RuntimeIPCClient::GetInstance();
   rc->SendAsyncMessage(module->module_system_->GetV8Context(),
-                       std::string(*type), value_str, callback);
+                       std::string(*type), value_str, callback,
+                       timeout_ms, on_timeout);
 
   result.Set(true);
 }
@@ -9,8 +9,10 @@
 
 #include <v8/v8.h>
 
+#include <map>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "extensions/renderer/xwalk_extension_client.h"
 
@@ -41,7 +43,14 @@ class XWalkExtensionModule : public XWalkExtensionClient::InstanceHandler {
 
  private:
   // ExtensionClient::InstanceHandler implementation.
-  virtual void HandleMessageFromNative(const std::string& msg);
+  virtual void HandleMessagesFromNative(
+      const std::vector<XWalkExtensionClient::Message>& msgs);
+  virtual void HandleStreamChunkFromNative(
+      int stream, const XWalkExtensionClient::Message& chunk);
+  virtual void HandleStreamEndFromNative(int stream, const std::string& error);
+
+  v8::Handle<v8::Function> GetStreamFactory(v8::Handle<v8::Context> context);
+  void ReleaseStream(int stream);
 
   // Callbacks for JS functions available in 'extension' object.
   static void PostMessageCallback(
@@ -50,6 +59,14 @@ class XWalkExtensionModule : public XWalkExtensionClient::InstanceHandler {
       const v8::FunctionCallbackInfo<v8::Value>& info);
   static void SetMessageListenerCallback(
       const v8::FunctionCallbackInfo<v8::Value>& info);
+  static void SetBatchMessageListenerCallback(
+      const v8::FunctionCallbackInfo<v8::Value>& info);
+  static void OpenStreamCallback(
+      const v8::FunctionCallbackInfo<v8::Value>& info);
+  static void PullStreamCallback(
+      const v8::FunctionCallbackInfo<v8::Value>& info);
+  static void CancelStreamCallback(
+      const v8::FunctionCallbackInfo<v8::Value>& info);
   static void SendRuntimeMessageCallback(
       const v8::FunctionCallbackInfo<v8::Value>& info);
   static void SendRuntimeSyncMessageCallback(
@@ -71,6 +88,21 @@ class XWalkExtensionModule : public XWalkExtensionClient::InstanceHandler {
   // This value is registered by using 'extension.setMessageListener()'.
   v8::Persistent<v8::Function> message_listener_;
 
+  // Function to be called with an array of all the messages received at once
+  // from the extension. When set, it is used instead of |message_listener_|.
+  // This value is registered by using 'extension.setBatchMessageListener()'.
+  v8::Persistent<v8::Function> batch_message_listener_;
+
+  // Creates the JS side of a stream opened by 'extension.openStream()', see
+  // kCreateStreamCode. Compiled on first use.
+  v8::Persistent<v8::Function> stream_factory_;
+
+  // The open streams, by id. Each one is the object returned by the stream
+  // factory, whose push() and end() functions feed the stream.
+  typedef std::map<int, v8::Persistent<v8::Object>*> StreamMap;
+  StreamMap streams_;
+  int last_stream_id_;
+
   std::string extension_name_;
   std::string extension_code_;
 
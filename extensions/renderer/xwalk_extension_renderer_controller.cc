@@ -7,6 +7,7 @@
 
 #include <Ecore.h>
 #include <v8/v8.h>
+#include <set>
 #include <string>
 #include <utility>
 
@@ -27,6 +28,16 @@ int XWalkExtensionRendererController::plugin_session_count = 0;
 
 namespace {
 
+// The module system is only created on first use with the namespace
+// interceptor. Without it, an extension with nested names, e.g. tizen next to
+// tizen.time, is loaded by XWalkModuleSystem::Initialize(), so the module
+// system is created with the context anyway.
+#ifdef NAMESPACE_INTERCEPTOR
+const bool kCreateModuleSystemOnFirstUse = true;
+#else
+const bool kCreateModuleSystemOnFirstUse = false;
+#endif
+
 void CreateExtensionModules(XWalkExtensionClient* client,
                             XWalkModuleSystem* module_system) {
   const XWalkExtensionClient::ExtensionAPIMap& extensions =
@@ -42,6 +53,10 @@ void CreateExtensionModules(XWalkExtensionClient* client,
   }
 }
 
+std::string GetTopLevelName(const std::string& name) {
+  return name.substr(0, name.find('.'));
+}
+
 }  // namespace
 
 XWalkExtensionRendererController&
@@ -52,7 +67,9 @@ XWalkExtensionRendererController::GetInstance() {
 
 XWalkExtensionRendererController::XWalkExtensionRendererController()
     : exit_requested(false),
-      extensions_client_(new XWalkExtensionClient()) {
+      extensions_client_(new XWalkExtensionClient()),
+      hooked_extension_count_(0),
+      create_module_system_eagerly_(false) {
 }
 
 XWalkExtensionRendererController::~XWalkExtensionRendererController() {
@@ -67,6 +84,98 @@ void XWalkExtensionRendererController::DidCreateScriptContext(
     return;
   }
 
+  ObjectToolsModule::InitializeContext(context);
+  extensions_client_->Initialize();
+
+  std::vector<std::string> hooks;
+  if (!kCreateModuleSystemOnFirstUse || GetNamespaceHooks(&hooks)) {
+    v8::Context::Scope context_scope(context);
+    CreateModuleSystem(context);
+  } else {
+    InstallModuleSystemHooks(context, hooks);
+  }
+
+  plugin_session_count++;
+  LOGGER(DEBUG) << "plugin_session_count : " << plugin_session_count;
+}
+
+// Copies the top-level names of the extensions to |hooks|, and returns
+// whether the module system must be created with the context, because
+// an extension is loaded when the module system is initialized. The lists
+// are built again when extensions were added, e.g. by LoadUserExtensions().
+bool XWalkExtensionRendererController::GetNamespaceHooks(
+    std::vector<std::string>* hooks) {
+  const XWalkExtensionClient::ExtensionAPIMap& extensions =
+      extensions_client_->extension_apis();
+  if (extensions.size() != hooked_extension_count_) {
+    std::set<std::string> names;
+    std::set<std::string> top_level_names;
+    for (auto it = extensions.begin(); it != extensions.end(); ++it) {
+      names.insert(it->first);
+      top_level_names.insert(GetTopLevelName(it->first));
+      auto& entry_points = it->second->entry_points;
+      for (auto ep = entry_points.begin(); ep != entry_points.end(); ++ep) {
+        names.insert(*ep);
+        top_level_names.insert(GetTopLevelName(*ep));
+      }
+    }
+    create_module_system_eagerly_ = false;
+    for (auto it = extensions.begin(); it != extensions.end(); ++it) {
+      if (XWalkModuleSystem::IsLoadedByInitialize(it->first, names)) {
+        create_module_system_eagerly_ = true;
+        break;
+      }
+    }
+    namespace_hooks_.assign(top_level_names.begin(), top_level_names.end());
+    hooked_extension_count_ = extensions.size();
+  }
+  *hooks = namespace_hooks_;
+  return create_module_system_eagerly_;
+}
+
+// Most of the contexts (e.g. iframes) never use an extension, so instead of
+// setting up the module system when the context is created, only a hook for
+// each top-level namespace is set on the global object. The module system is
+// created when any of them is accessed for the first time. This is only done
+// with the namespace interceptor, and when no extension has to be loaded with
+// the context, such as xwalk.
+void XWalkExtensionRendererController::InstallModuleSystemHooks(
+    v8::Handle<v8::Context> context,
+    const std::vector<std::string>& hooks) {
+  v8::Isolate* isolate = context->GetIsolate();
+  v8::HandleScope handle_scope(isolate);
+  v8::Handle<v8::Object> global = context->Global();
+  for (auto it = hooks.begin(); it != hooks.end(); ++it) {
+    // The hooks can't be deleted by the page, so that it can't define its own
+    // object in place of an extension namespace.
+    global->SetAccessor(v8::String::NewFromUtf8(isolate, it->c_str()),
+                        ModuleSystemHookGetter,
+                        ModuleSystemHookSetter,
+                        v8::Handle<v8::Value>(),
+                        v8::DEFAULT,
+                        v8::DontDelete);
+  }
+}
+
+void XWalkExtensionRendererController::CreateModuleSystem(
+    v8::Handle<v8::Context> context) {
+  SCOPE_PROFILE();
+  if (XWalkModuleSystem::GetModuleSystemFromContext(context))
+    return;
+
+  v8::Isolate* isolate = context->GetIsolate();
+  v8::Handle<v8::Object> global = context->Global();
+  std::vector<std::string> hooks;
+  GetNamespaceHooks(&hooks);
+  for (auto it = hooks.begin(); it != hooks.end(); ++it) {
+    global->ForceDelete(v8::String::NewFromUtf8(isolate, it->c_str()));
+  }
+
+  // Skip plugin loading after application exit request.
+  if (exit_requested) {
+    return;
+  }
+
   XWalkModuleSystem* module_system = new XWalkModuleSystem(context);
   XWalkModuleSystem::SetModuleSystemInContext(
       std::unique_ptr<XWalkModuleSystem>(module_system), context);
@@ -80,17 +189,38 @@ void XWalkExtensionRendererController::DidCreateScriptContext(
         "objecttools",
         std::unique_ptr<XWalkNativeModule>(new ObjectToolsModule));
 
-  extensions_client_->Initialize();
   CreateExtensionModules(extensions_client_.get(), module_system);
 
   module_system->Initialize();
-  plugin_session_count++;
-  LOGGER(DEBUG) << "plugin_session_count : " << plugin_session_count;
+}
+
+// static
+void XWalkExtensionRendererController::ModuleSystemHookGetter(
+    v8::Local<v8::String> property,
+    const v8::PropertyCallbackInfo<v8::Value>& info) {
+  // The hook may be reached from another frame, so the module system is
+  // created in the context owning the global object.
+  v8::Handle<v8::Context> context = info.Holder()->CreationContext();
+  v8::Context::Scope context_scope(context);
+  GetInstance().CreateModuleSystem(context);
+  info.GetReturnValue().Set(context->Global()->Get(property));
+}
+
+// static
+void XWalkExtensionRendererController::ModuleSystemHookSetter(
+    v8::Local<v8::String> property,
+    v8::Local<v8::Value> value,
+    const v8::PropertyCallbackInfo<void>& info) {
+  v8::Handle<v8::Context> context = info.Holder()->CreationContext();
+  v8::Context::Scope context_scope(context);
+  GetInstance().CreateModuleSystem(context);
+  context->Global()->Set(property, value);
 }
 
 void XWalkExtensionRendererController::WillReleaseScriptContext(
     v8::Handle<v8::Context> context) {
   v8::Context::Scope contextScope(context);
+  RuntimeIPCClient::GetInstance()->CancelPendingMessages(context);
   XWalkModuleSystem::ResetModuleSystemFromContext(context);
   plugin_session_count--;
   LOGGER(DEBUG) << "plugin_session_count : " << plugin_session_count;
@@ -105,7 +235,7 @@ void XWalkExtensionRendererController::OnReceivedIPCMessage(
   if (TYPE_BEGIN("xwalk://"))  {
     Eina_Stringshare* id = ewk_ipc_wrt_message_data_id_get(data);
     Eina_Stringshare* msg = ewk_ipc_wrt_message_data_value_get(data);
-    extensions_client_->OnReceivedIPCMessage(id, msg);
+    extensions_client_->OnReceivedIPCMessage(type, id, msg);
     eina_stringshare_del(id);
     eina_stringshare_del(msg);
   } else {
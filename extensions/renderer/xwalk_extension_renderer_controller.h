@@ -12,6 +12,7 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 
 namespace extensions {
 
@@ -36,8 +37,27 @@ class XWalkExtensionRendererController {
   XWalkExtensionRendererController();
   virtual ~XWalkExtensionRendererController();
 
+  bool GetNamespaceHooks(std::vector<std::string>* hooks);
+  void InstallModuleSystemHooks(v8::Handle<v8::Context> context,
+                                const std::vector<std::string>& hooks);
+  void CreateModuleSystem(v8::Handle<v8::Context> context);
+
+  static void ModuleSystemHookGetter(
+      v8::Local<v8::String> property,
+      const v8::PropertyCallbackInfo<v8::Value>& info);
+  static void ModuleSystemHookSetter(
+      v8::Local<v8::String> property,
+      v8::Local<v8::Value> value,
+      const v8::PropertyCallbackInfo<void>& info);
+
  private:
   std::unique_ptr<XWalkExtensionClient> extensions_client_;
+
+  // Top-level names of the extensions and their entry points, e.g. "tizen".
+  std::vector<std::string> namespace_hooks_;
+  // Number of extensions |namespace_hooks_| was built from.
+  size_t hooked_extension_count_;
+  bool create_module_system_eagerly_;
 };
 
 }  // namespace extensions
@@ -7,8 +7,6 @@
 
 #include <v8/v8.h>
 
-#include <algorithm>
-
 #include "common/logger.h"
 #include "common/profiler.h"
 #include "extensions/renderer/xwalk_extension_module.h"
@@ -26,6 +24,17 @@ const int kModuleSystemEmbedderDataIndex = 8;
 // pointer back to XWalkExtensionModule.
 const char* kXWalkModuleSystem = "kXWalkModuleSystem";
 
+// When enabled, only the top-level names get trampolines and each namespace
+// object gets a single named property interceptor in its prototype chain,
+// which loads the extensions nested in it on demand. Names that are not
+// loaded yet aren't own properties of the namespace, so they don't show up in
+// Object.keys() until they are accessed.
+#ifdef NAMESPACE_INTERCEPTOR
+const bool kUseNamespaceInterceptor = true;
+#else
+const bool kUseNamespaceInterceptor = false;
+#endif
+
 void RequireNativeCallback(const v8::FunctionCallbackInfo<v8::Value>& info) {
   v8::ReturnValue<v8::Value> result(info.GetReturnValue());
 
@@ -92,6 +101,13 @@ XWalkModuleSystem::~XWalkModuleSystem() {
   v8::Isolate* isolate = v8::Isolate::GetCurrent();
   v8::HandleScope handle_scope(isolate);
 
+  auto instance_it = native_module_instances_.begin();
+  for ( ; instance_it != native_module_instances_.end(); ++instance_it) {
+    instance_it->second->Reset();
+    delete instance_it->second;
+  }
+  native_module_instances_.clear();
+
   require_native_template_.Reset();
   function_data_.Reset();
   v8_context_.Reset();
@@ -147,6 +163,14 @@ void XWalkModuleSystem::RegisterExtensionModule(
 
   extension_modules_.push_back(
       ExtensionModuleEntry(extension_name, module.release(), entry_points));
+  ExtensionModuleEntry* entry = &extension_modules_.back();
+
+  NamespaceNode* node = AddNamespaceNode(extension_name);
+  node->entry = entry;
+  node->is_extension_name = true;
+  for (it = entry_points.begin(); it != entry_points.end(); ++it) {
+    AddNamespaceNode(*it)->entry = entry;
+  }
 }
 
 void XWalkModuleSystem::RegisterNativeModule(
@@ -160,35 +184,6 @@ void XWalkModuleSystem::RegisterNativeModule(
 
 namespace {
 
-v8::Handle<v8::Value> EnsureTargetObjectForTrampoline(
-    v8::Handle<v8::Context> context, const std::vector<std::string>& path,
-    std::string* error) {
-  v8::Handle<v8::Object> object = context->Global();
-  v8::Isolate* isolate = context->GetIsolate();
-
-  std::vector<std::string>::const_iterator it = path.begin();
-  for (; it != path.end(); ++it) {
-    v8::Handle<v8::String> part =
-        v8::String::NewFromUtf8(isolate, it->c_str());
-    v8::Handle<v8::Value> value = object->Get(part);
-
-    if (value->IsUndefined()) {
-      v8::Handle<v8::Object> next_object = v8::Object::New(isolate);
-      object->Set(part, next_object);
-      object = next_object;
-      continue;
-    }
-
-    if (!value->IsObject()) {
-      *error = "the property '" + *it + "' in the path is undefined";
-      return v8::Undefined(isolate);
-    }
-
-    object = value.As<v8::Object>();
-  }
-  return object;
-}
-
 v8::Handle<v8::Value> GetObjectForPath(v8::Handle<v8::Context> context,
                                        const std::vector<std::string>& path,
                                        std::string* error) {
@@ -230,24 +225,11 @@ void SplitString(const STR& str, const typename STR::value_type s,
 }
 
 bool XWalkModuleSystem::SetTrampolineAccessorForEntryPoint(
-    v8::Handle<v8::Context> context,
+    v8::Handle<v8::Object> holder,
+    v8::Handle<v8::String> basename,
     const std::string& entry_point,
     v8::Local<v8::External> user_data) {
-  std::vector<std::string> path;
-  SplitString(entry_point, '.', &path);
-  std::string basename = path.back();
-  path.pop_back();
-
-  std::string error;
-  v8::Handle<v8::Value> value =
-      EnsureTargetObjectForTrampoline(context, path, &error);
-  if (value->IsUndefined()) {
-    LOGGER(ERROR) << "Error installing trampoline for " << entry_point
-                  << " : " << error;
-    return false;
-  }
-
-  v8::Isolate* isolate = context->GetIsolate();
+  v8::Isolate* isolate = v8::Isolate::GetCurrent();
   v8::Local<v8::Array> params = v8::Array::New(isolate);
   v8::Local<v8::String> entry =
       v8::String::NewFromUtf8(isolate, entry_point.c_str());
@@ -255,10 +237,8 @@ bool XWalkModuleSystem::SetTrampolineAccessorForEntryPoint(
   params->Set(v8::Integer::New(isolate, 1), entry);
 
   // FIXME(cmarcelo): ensure that trampoline is readonly.
-  value.As<v8::Object>()->SetAccessor(
-      v8::String::NewFromUtf8(isolate, basename.c_str()),
-      TrampolineCallback, TrampolineSetterCallback, params);
-  return true;
+  return holder->SetAccessor(basename, TrampolineCallback,
+                             TrampolineSetterCallback, params);
 }
 
 // static
@@ -283,27 +263,64 @@ bool XWalkModuleSystem::DeleteAccessorForEntryPoint(
   return true;
 }
 
-bool XWalkModuleSystem::InstallTrampoline(v8::Handle<v8::Context> context,
-                                     ExtensionModuleEntry* entry) {
-  v8::Local<v8::External> entry_ptr =
-      v8::External::New(context->GetIsolate(), entry);
-  bool ret = SetTrampolineAccessorForEntryPoint(context, entry->name,
-                                                entry_ptr);
-  if (!ret) {
-    LOGGER(ERROR) << "Error installing trampoline for " << entry->name;
-    return false;
-  }
+// Walks the namespace tree, resolving each object on the way only once for
+// all the names nested in it. Extensions marked with trampoline get accessors
+// for their name and entry points, the others have their code loaded. Parents
+// are visited before their children, so an extension is always loaded before
+// the namespaces nested in it get their trampolines.
+void XWalkModuleSystem::InstallNamespace(
+    v8::Handle<v8::Context> context,
+    v8::Handle<v8::Object> holder,
+    NamespaceNode* node,
+    const std::string& path,
+    v8::Handle<v8::Function> require_native) {
+  v8::Isolate* isolate = context->GetIsolate();
 
-  auto it = entry->entry_points.begin();
-  for (; it != entry->entry_points.end(); ++it) {
-    ret = SetTrampolineAccessorForEntryPoint(context, *it, entry_ptr);
-    if (!ret) {
-      // TODO(vcgomes): Remove already added trampolines when it fails.
-      LOGGER(ERROR) << "Error installing trampoline for " << entry->name;
-      return false;
+  auto it = node->children.begin();
+  for (; it != node->children.end(); ++it) {
+    NamespaceNode* child = it->second;
+    std::string child_path = path.empty() ? it->first : path + "." + it->first;
+    v8::Handle<v8::String> basename =
+        v8::String::NewFromUtf8(isolate, it->first.c_str());
+
+    ExtensionModuleEntry* entry = child->entry;
+    if (entry && entry->use_trampoline) {
+      if (!SetTrampolineAccessorForEntryPoint(
+              holder, basename, child_path,
+              v8::External::New(isolate, entry))) {
+        LOGGER(ERROR) << "Error installing trampoline for " << child_path;
+      }
+    } else if (entry && child->is_extension_name) {
+      entry->module->LoadExtensionCode(context, require_native);
+      holder->ForceSet(basename, holder->Get(basename), v8::ReadOnly);
     }
+
+    if (child->children.empty())
+      continue;
+
+    // The interceptor of a trampolined extension is set once its code is
+    // loaded, as the code replaces the namespace object.
+    if (kUseNamespaceInterceptor && entry && entry->use_trampoline)
+      continue;
+
+    v8::Handle<v8::Value> value = holder->Get(basename);
+    if (value->IsUndefined()) {
+      value = v8::Object::New(isolate);
+      holder->Set(basename, value);
+    }
+    if (!value->IsObject()) {
+      LOGGER(ERROR) << "Error installing trampolines under " << child_path
+                    << " : the property '" << it->first << "' in the path is "
+                    << "not an object";
+      continue;
+    }
+    if (kUseNamespaceInterceptor) {
+      SetNamespaceInterceptor(value.As<v8::Object>(), child_path);
+      continue;
+    }
+    InstallNamespace(context, value.As<v8::Object>(), child, child_path,
+                     require_native);
   }
-  return true;
 }
 
 v8::Handle<v8::Object> XWalkModuleSystem::RequireNative(
@@ -311,7 +328,19 @@ v8::Handle<v8::Object> XWalkModuleSystem::RequireNative(
   NativeModuleMap::iterator it = native_modules_.find(name);
   if (it == native_modules_.end())
     return v8::Handle<v8::Object>();
-  return it->second->NewInstance();
+
+  v8::Isolate* isolate = v8::Isolate::GetCurrent();
+  NativeModuleInstanceMap::iterator instance_it =
+      native_module_instances_.find(name);
+  if (instance_it != native_module_instances_.end())
+    return v8::Local<v8::Object>::New(isolate, *instance_it->second);
+
+  v8::Handle<v8::Object> instance = it->second->NewInstance();
+  if (instance.IsEmpty())
+    return instance;
+  native_module_instances_[name] =
+      new v8::Persistent<v8::Object>(isolate, instance);
+  return instance;
 }
 
 void XWalkModuleSystem::Initialize() {
@@ -326,13 +355,8 @@ void XWalkModuleSystem::Initialize() {
 
   MarkModulesWithTrampoline();
 
-  auto it = extension_modules_.begin();
-  for (; it != extension_modules_.end(); ++it) {
-    if (it->use_trampoline && InstallTrampoline(context, &*it))
-      continue;
-    it->module->LoadExtensionCode(context, require_native);
-    EnsureExtensionNamespaceIsReadOnly(context, it->name);
-  }
+  InstallNamespace(context, context->Global(), &namespace_root_,
+                   std::string(), require_native);
 }
 
 v8::Handle<v8::Context> XWalkModuleSystem::GetV8Context() {
@@ -341,18 +365,38 @@ v8::Handle<v8::Context> XWalkModuleSystem::GetV8Context() {
 
 bool XWalkModuleSystem::ContainsEntryPoint(
     const std::string& entry) {
-  auto it = extension_modules_.begin();
-  for (; it != extension_modules_.end(); ++it) {
-    if (it->name == entry)
-      return true;
-
-    auto entry_it = std::find(
-        it->entry_points.begin(), it->entry_points.end(), entry);
-    if (entry_it != it->entry_points.end()) {
-      return true;
-    }
+  NamespaceNode* node = FindNamespaceNode(entry);
+  return node && node->entry;
+}
+
+XWalkModuleSystem::NamespaceNode* XWalkModuleSystem::FindNamespaceNode(
+    const std::string& name) {
+  std::vector<std::string> path;
+  SplitString(name, '.', &path);
+
+  NamespaceNode* node = &namespace_root_;
+  auto it = path.begin();
+  for (; it != path.end() && node; ++it) {
+    NamespaceNode::Children::iterator child = node->children.find(*it);
+    node = child == node->children.end() ? NULL : child->second;
+  }
+  return node;
+}
+
+XWalkModuleSystem::NamespaceNode* XWalkModuleSystem::AddNamespaceNode(
+    const std::string& name) {
+  std::vector<std::string> path;
+  SplitString(name, '.', &path);
+
+  NamespaceNode* node = &namespace_root_;
+  auto it = path.begin();
+  for (; it != path.end(); ++it) {
+    NamespaceNode*& child = node->children[*it];
+    if (!child)
+      child = new NamespaceNode;
+    node = child;
   }
-  return false;
+  return node;
 }
 
 void XWalkModuleSystem::DeleteExtensionModules() {
@@ -377,26 +421,199 @@ void XWalkModuleSystem::LoadExtensionForTrampoline(
     return;
 
   v8::Handle<v8::Context> context = isolate->GetCurrentContext();
+  XWalkModuleSystem* module_system = GetModuleSystemFromContext(context);
+  if (!module_system)
+    return;
 
-  DeleteAccessorForEntryPoint(context, entry->name);
+  module_system->LoadTrampolinedExtension(context, entry);
+}
+
+void XWalkModuleSystem::LoadTrampolinedExtension(
+    v8::Handle<v8::Context> context,
+    ExtensionModuleEntry* entry) {
+  if (!entry->use_trampoline)
+    return;
+  entry->use_trampoline = false;
+
+  // With the namespace interceptor only the top-level names have accessors,
+  // looking up the other ones would load the namespaces holding them.
+  if (!kUseNamespaceInterceptor ||
+      entry->name.find('.') == std::string::npos)
+    DeleteAccessorForEntryPoint(context, entry->name);
 
   auto it = entry->entry_points.begin();
   for (; it != entry->entry_points.end(); ++it) {
-    DeleteAccessorForEntryPoint(context, *it);
+    if (!kUseNamespaceInterceptor || it->find('.') == std::string::npos)
+      DeleteAccessorForEntryPoint(context, *it);
   }
 
-  XWalkModuleSystem* module_system = GetModuleSystemFromContext(context);
+  v8::Isolate* isolate = context->GetIsolate();
   v8::Handle<v8::FunctionTemplate> require_native_template =
-      v8::Local<v8::FunctionTemplate>::New(
-          isolate,
-          module_system->require_native_template_);
-
+      v8::Local<v8::FunctionTemplate>::New(isolate, require_native_template_);
 
   XWalkExtensionModule* module = entry->module;
-  module->LoadExtensionCode(module_system->GetV8Context(),
+  module->LoadExtensionCode(GetV8Context(),
                             require_native_template->GetFunction());
 
-  module_system->EnsureExtensionNamespaceIsReadOnly(context, entry->name);
+  EnsureExtensionNamespaceIsReadOnly(context, entry->name);
+
+  if (!kUseNamespaceInterceptor)
+    return;
+
+  NamespaceNode* node = FindNamespaceNode(entry->name);
+  if (!node || node->children.empty())
+    return;
+
+  std::vector<std::string> path;
+  SplitString(entry->name, '.', &path);
+  std::string error;
+  v8::Handle<v8::Value> value = GetObjectForPath(context, path, &error);
+  if (value->IsUndefined()) {
+    LOGGER(ERROR) << "Error retrieving object for " << entry->name << " : "
+                  << error;
+    return;
+  }
+  SetNamespaceInterceptor(value.As<v8::Object>(), entry->name);
+}
+
+// static
+void XWalkModuleSystem::SetNamespaceInterceptor(v8::Handle<v8::Object> object,
+                                                const std::string& path) {
+  v8::Isolate* isolate = v8::Isolate::GetCurrent();
+  v8::Handle<v8::ObjectTemplate> object_template =
+      v8::ObjectTemplate::New(isolate);
+  object_template->SetNamedPropertyHandler(
+      NamespaceInterceptorGetter,
+      NamespaceInterceptorSetter,
+      NamespaceInterceptorQuery,
+      NULL,
+      NamespaceInterceptorEnumerator,
+      v8::String::NewFromUtf8(isolate, path.c_str()));
+
+  v8::Handle<v8::Object> interceptor = object_template->NewInstance();
+  interceptor->SetPrototype(object->GetPrototype());
+  if (!object->SetPrototype(interceptor)) {
+    LOGGER(ERROR) << "Error installing namespace interceptor for " << path;
+  }
+}
+
+// static
+XWalkModuleSystem::NamespaceNode* XWalkModuleSystem::FindInterceptedNode(
+    v8::Isolate* isolate,
+    v8::Local<v8::Value> data,
+    v8::Local<v8::String> property,
+    std::string* path) {
+  XWalkModuleSystem* module_system =
+      GetModuleSystemFromContext(isolate->GetCurrentContext());
+  if (!module_system)
+    return NULL;
+
+  *path = std::string(*v8::String::Utf8Value(data)) + "." +
+          *v8::String::Utf8Value(property);
+  return module_system->FindNamespaceNode(*path);
+}
+
+// Loads the extension registered as |property| of the namespace in |data|,
+// or creates the intermediate namespace object if only nested names are
+// registered under it. Returns false if nothing is registered there.
+// static
+bool XWalkModuleSystem::LoadNamespaceProperty(
+    v8::Isolate* isolate,
+    v8::Local<v8::Value> data,
+    v8::Local<v8::String> property,
+    v8::Handle<v8::Object>* holder) {
+  std::string path;
+  NamespaceNode* node = FindInterceptedNode(isolate, data, property, &path);
+  if (!node)
+    return false;
+
+  v8::Handle<v8::Context> context = isolate->GetCurrentContext();
+  if (node->entry && node->entry->use_trampoline) {
+    GetModuleSystemFromContext(context)->LoadTrampolinedExtension(
+        context, node->entry);
+  }
+
+  std::vector<std::string> parent_path;
+  SplitString(std::string(*v8::String::Utf8Value(data)), '.', &parent_path);
+  std::string error;
+  v8::Handle<v8::Value> value = GetObjectForPath(context, parent_path, &error);
+  if (value->IsUndefined()) {
+    LOGGER(ERROR) << "Error retrieving object for " << path << " : " << error;
+    return false;
+  }
+  *holder = value.As<v8::Object>();
+
+  if (!node->entry && !(*holder)->HasRealNamedProperty(property)) {
+    v8::Handle<v8::Object> object = v8::Object::New(isolate);
+    SetNamespaceInterceptor(object, path);
+    (*holder)->Set(property, object);
+  }
+  return true;
+}
+
+// static
+void XWalkModuleSystem::NamespaceInterceptorGetter(
+    v8::Local<v8::String> property,
+    const v8::PropertyCallbackInfo<v8::Value>& info) {
+  v8::Handle<v8::Object> holder;
+  if (!LoadNamespaceProperty(info.GetIsolate(), info.Data(), property,
+                             &holder))
+    return;
+
+  // Skips the interceptors, so a name left undefined by its extension code
+  // doesn't bring us back here.
+  v8::Local<v8::Value> value = holder->GetRealNamedProperty(property);
+  if (!value.IsEmpty())
+    info.GetReturnValue().Set(value);
+}
+
+// static
+void XWalkModuleSystem::NamespaceInterceptorSetter(
+    v8::Local<v8::String> property,
+    v8::Local<v8::Value> value,
+    const v8::PropertyCallbackInfo<v8::Value>& info) {
+  v8::Handle<v8::Object> holder;
+  if (!LoadNamespaceProperty(info.GetIsolate(), info.Data(), property,
+                             &holder))
+    return;
+
+  if (holder->HasRealNamedProperty(property))
+    holder->Set(property, value);
+  else
+    holder->ForceSet(property, value);
+  info.GetReturnValue().Set(value);
+}
+
+// static
+void XWalkModuleSystem::NamespaceInterceptorQuery(
+    v8::Local<v8::String> property,
+    const v8::PropertyCallbackInfo<v8::Integer>& info) {
+  std::string path;
+  if (FindInterceptedNode(info.GetIsolate(), info.Data(), property, &path))
+    info.GetReturnValue().Set(static_cast<int32_t>(v8::None));
+}
+
+// static
+void XWalkModuleSystem::NamespaceInterceptorEnumerator(
+    const v8::PropertyCallbackInfo<v8::Array>& info) {
+  v8::Isolate* isolate = info.GetIsolate();
+  XWalkModuleSystem* module_system =
+      GetModuleSystemFromContext(isolate->GetCurrentContext());
+  if (!module_system)
+    return;
+
+  NamespaceNode* node = module_system->FindNamespaceNode(
+      *v8::String::Utf8Value(info.Data()));
+  if (!node)
+    return;
+
+  v8::Local<v8::Array> names = v8::Array::New(isolate, node->children.size());
+  uint32_t index = 0;
+  auto it = node->children.begin();
+  for (; it != node->children.end(); ++it) {
+    names->Set(index++, v8::String::NewFromUtf8(isolate, it->first.c_str()));
+  }
+  info.GetReturnValue().Set(names);
 }
 
 // static
@@ -451,15 +668,14 @@ XWalkModuleSystem::ExtensionModuleEntry::ExtensionModuleEntry(
 XWalkModuleSystem::ExtensionModuleEntry::~ExtensionModuleEntry() {
 }
 
-// Returns whether the name of first is prefix of the second, considering "."
-// character as a separator. So "a" is prefix of "a.b" but not of "ab".
-bool XWalkModuleSystem::ExtensionModuleEntry::IsPrefix(
-    const ExtensionModuleEntry& first,
-    const ExtensionModuleEntry& second) {
-  const std::string& p = first.name;
-  const std::string& s = second.name;
-  return s.size() > p.size() && s[p.size()] == '.'
-      && std::mismatch(p.begin(), p.end(), s.begin()).first == p.end();
+XWalkModuleSystem::NamespaceNode::NamespaceNode()
+    : entry(NULL), is_extension_name(false) {
+}
+
+XWalkModuleSystem::NamespaceNode::~NamespaceNode() {
+  for (auto it = children.begin(); it != children.end(); ++it) {
+    delete it->second;
+  }
 }
 
 // Mark the extension modules that we want to setup "trampolines"
@@ -470,32 +686,51 @@ bool XWalkModuleSystem::ExtensionModuleEntry::IsPrefix(
 // For example, if there are two extensions "tizen" and "tizen.time",
 // the first one won't be marked with trampoline, but the second one
 // will. So we'll only load code for "tizen" extension.
+//
+// With the namespace interceptor the nested names are resolved only after
+// their parent is loaded, so every extension can use a trampoline.
 void XWalkModuleSystem::MarkModulesWithTrampoline() {
-  std::sort(extension_modules_.begin(), extension_modules_.end());
-  {
-    ExtensionModules::iterator it = extension_modules_.begin();
-    while (it != extension_modules_.end()) {
-      it = std::adjacent_find(it, extension_modules_.end(),
-                              &ExtensionModuleEntry::IsPrefix);
-      if (it == extension_modules_.end())
-        break;
-      it->use_trampoline = false;
-      ++it;
-    }
-  }
+  if (!kUseNamespaceInterceptor)
+    MarkNamespaceWithTrampoline(&namespace_root_);
 
   // NOTE: Special Case for Security Reason
   // xwalk module should not be trampolined even it does not have any children.
-  {
-    ExtensionModules::iterator it = extension_modules_.begin();
-    while (it != extension_modules_.end()) {
-      if ("xwalk" == (*it).name) {
-        it->use_trampoline = false;
-        break;
-      }
-      ++it;
-    }
+  NamespaceNode* node = FindNamespaceNode("xwalk");
+  if (node && node->is_extension_name)
+    node->entry->use_trampoline = false;
+}
+
+// Follows MarkModulesWithTrampoline() without a namespace tree.
+// static
+bool XWalkModuleSystem::IsLoadedByInitialize(
+    const std::string& name,
+    const std::set<std::string>& names) {
+  if (name == "xwalk")
+    return true;
+  if (kUseNamespaceInterceptor)
+    return false;
+  // Without the interceptor, only the leaves of the namespace tree get a
+  // trampoline.
+  std::string prefix = name + ".";
+  auto it = names.lower_bound(prefix);
+  return it != names.end() && it->compare(0, prefix.size(), prefix) == 0;
+}
+
+// Returns whether an extension is named by |node| or by any node below it.
+// static
+bool XWalkModuleSystem::MarkNamespaceWithTrampoline(NamespaceNode* node) {
+  bool has_nested_extension = false;
+  auto it = node->children.begin();
+  for (; it != node->children.end(); ++it) {
+    if (MarkNamespaceWithTrampoline(it->second))
+      has_nested_extension = true;
   }
+
+  if (!node->is_extension_name)
+    return has_nested_extension;
+
+  node->entry->use_trampoline = !has_nested_extension;
+  return true;
 }
 
 void XWalkModuleSystem::EnsureExtensionNamespaceIsReadOnly(
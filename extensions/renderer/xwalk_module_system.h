@@ -8,8 +8,10 @@
 
 #include <v8/v8.h>
 
+#include <list>
 #include <map>
 #include <memory>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -46,6 +48,12 @@ class XWalkModuleSystem {
 
   void Initialize();
 
+  // Whether Initialize() loads the extension |name| at once instead of
+  // installing a trampoline for it. |names| holds the names and entry points
+  // of all the extensions.
+  static bool IsLoadedByInitialize(const std::string& name,
+                                   const std::set<std::string>& names);
+
   v8::Handle<v8::Context> GetV8Context();
 
  private:
@@ -57,24 +65,40 @@ class XWalkModuleSystem {
     XWalkExtensionModule* module;
     bool use_trampoline;
     std::vector<std::string> entry_points;
-    bool operator<(const ExtensionModuleEntry& other) const {
-      return name < other.name;
-    }
+  };
 
-    static bool IsPrefix(const ExtensionModuleEntry& first,
-                         const ExtensionModuleEntry& second);
+  // Node of the dotted namespace tree built from the names and entry points
+  // of the registered extensions, e.g. "tizen.time" is the child "time" of
+  // the "tizen" node.
+  struct NamespaceNode {
+    NamespaceNode();
+    ~NamespaceNode();
+    typedef std::map<std::string, NamespaceNode*> Children;
+    Children children;
+    // Extension whose name or entry point ends at this node, NULL for the
+    // intermediate nodes.
+    ExtensionModuleEntry* entry;
+    // Whether this node is the name of |entry| or one of its entry points.
+    bool is_extension_name;
   };
 
+  NamespaceNode* FindNamespaceNode(const std::string& name);
+  NamespaceNode* AddNamespaceNode(const std::string& name);
+
   bool SetTrampolineAccessorForEntryPoint(
-      v8::Handle<v8::Context> context,
+      v8::Handle<v8::Object> holder,
+      v8::Handle<v8::String> basename,
       const std::string& entry_point,
       v8::Local<v8::External> user_data);
 
   static bool DeleteAccessorForEntryPoint(v8::Handle<v8::Context> context,
                                           const std::string& entry_point);
 
-  bool InstallTrampoline(v8::Handle<v8::Context> context,
-                         ExtensionModuleEntry* entry);
+  void InstallNamespace(v8::Handle<v8::Context> context,
+                        v8::Handle<v8::Object> holder,
+                        NamespaceNode* node,
+                        const std::string& path,
+                        v8::Handle<v8::Function> require_native);
 
   static void TrampolineCallback(
       v8::Local<v8::String> property,
@@ -86,22 +110,57 @@ class XWalkModuleSystem {
   static void LoadExtensionForTrampoline(
       v8::Isolate* isolate,
       v8::Local<v8::Value> data);
+  void LoadTrampolinedExtension(v8::Handle<v8::Context> context,
+                                ExtensionModuleEntry* entry);
   static v8::Handle<v8::Value> RefetchHolder(
     v8::Isolate* isolate,
     v8::Local<v8::Value> data);
 
+  static void SetNamespaceInterceptor(v8::Handle<v8::Object> object,
+                                      const std::string& path);
+  static NamespaceNode* FindInterceptedNode(v8::Isolate* isolate,
+                                            v8::Local<v8::Value> data,
+                                            v8::Local<v8::String> property,
+                                            std::string* path);
+  static bool LoadNamespaceProperty(v8::Isolate* isolate,
+                                    v8::Local<v8::Value> data,
+                                    v8::Local<v8::String> property,
+                                    v8::Handle<v8::Object>* holder);
+  static void NamespaceInterceptorGetter(
+      v8::Local<v8::String> property,
+      const v8::PropertyCallbackInfo<v8::Value>& info);
+  static void NamespaceInterceptorSetter(
+      v8::Local<v8::String> property,
+      v8::Local<v8::Value> value,
+      const v8::PropertyCallbackInfo<v8::Value>& info);
+  static void NamespaceInterceptorQuery(
+      v8::Local<v8::String> property,
+      const v8::PropertyCallbackInfo<v8::Integer>& info);
+  static void NamespaceInterceptorEnumerator(
+      const v8::PropertyCallbackInfo<v8::Array>& info);
+
   bool ContainsEntryPoint(const std::string& entry_point);
   void MarkModulesWithTrampoline();
+  static bool MarkNamespaceWithTrampoline(NamespaceNode* node);
   void DeleteExtensionModules();
 
   void EnsureExtensionNamespaceIsReadOnly(v8::Handle<v8::Context> context,
                                           const std::string& extension_name);
 
-  typedef std::vector<ExtensionModuleEntry> ExtensionModules;
+  // Entries are referenced from the namespace tree, so they are kept in a
+  // list whose elements don't move when new modules are registered.
+  typedef std::list<ExtensionModuleEntry> ExtensionModules;
   ExtensionModules extension_modules_;
+  NamespaceNode namespace_root_;
   typedef std::map<std::string, XWalkNativeModule*> NativeModuleMap;
   NativeModuleMap native_modules_;
 
+  // Instances returned by requireNative(), created on first use and shared
+  // by every extension of this context.
+  typedef std::map<std::string, v8::Persistent<v8::Object>*>
+      NativeModuleInstanceMap;
+  NativeModuleInstanceMap native_module_instances_;
+
   v8::Persistent<v8::FunctionTemplate> require_native_template_;
   v8::Persistent<v8::Object> function_data_;
 
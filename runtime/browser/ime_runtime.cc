@@ -124,15 +124,18 @@ void ImeRuntime::OnCreate() {
   std::string appid = cmd->GetAppIdFromCommandLine(kRuntimeExecName);
 
   // Init AppDB for Runtime
-  common::AppDB* appdb = common::AppDB::GetInstance();
-  appdb->Set(kAppDBRuntimeSection, kAppDBRuntimeName, "xwalk-tizen");
-  appdb->Set(kAppDBRuntimeSection, kAppDBRuntimeAppID, appid);
+  common::AppDB::Transaction transaction(common::AppDB::GetInstance());
+  transaction.Set(kAppDBRuntimeSection, kAppDBRuntimeName, "xwalk-tizen");
+  transaction.Set(kAppDBRuntimeSection, kAppDBRuntimeAppID, appid);
   if (app_data_->setting_info()->background_support_enabled()) {
-    appdb->Set(kAppDBRuntimeSection, kAppDBRuntimeBackgroundSupport, "true");
+    transaction.Set(kAppDBRuntimeSection, kAppDBRuntimeBackgroundSupport,
+                    "true");
   } else {
-    appdb->Set(kAppDBRuntimeSection, kAppDBRuntimeBackgroundSupport, "false");
+    transaction.Set(kAppDBRuntimeSection, kAppDBRuntimeBackgroundSupport,
+                    "false");
   }
-  appdb->Remove(kAppDBRuntimeSection, kAppDBRuntimeBundle);
+  transaction.Remove(kAppDBRuntimeSection, kAppDBRuntimeBundle);
+  transaction.Commit();
 
   // Init ImeApplication
   native_window_ = CreateNativeWindow();
@@ -163,6 +166,7 @@ void ImeRuntime::OnCreate() {
 }
 
 void ImeRuntime::OnTerminate() {
+  common::AppDB::GetInstance()->Shutdown();
 }
 
 void ImeRuntime::Terminate() {
@@ -210,6 +214,7 @@ void ImeRuntime::OnShow(int context_id, ime_context_h context) {
 
 void ImeRuntime::OnHide(int context_id) {
   LOGGER(DEBUG) << "ime_app_hide";
+  common::AppDB::GetInstance()->Flush();
 }
 
 static void ime_app_focus_in_cb(int ic, void *user_data)
@@ -123,15 +123,18 @@ bool UiRuntime::OnCreate() {
   std::string appid = cmd->GetAppIdFromCommandLine(kRuntimeExecName);
 
   // Init AppDB for Runtime
-  common::AppDB* appdb = common::AppDB::GetInstance();
-  appdb->Set(kAppDBRuntimeSection, kAppDBRuntimeName, "xwalk-tizen");
-  appdb->Set(kAppDBRuntimeSection, kAppDBRuntimeAppID, appid);
+  common::AppDB::Transaction transaction(common::AppDB::GetInstance());
+  transaction.Set(kAppDBRuntimeSection, kAppDBRuntimeName, "xwalk-tizen");
+  transaction.Set(kAppDBRuntimeSection, kAppDBRuntimeAppID, appid);
   if (app_data_->setting_info()->background_support_enabled()) {
-    appdb->Set(kAppDBRuntimeSection, kAppDBRuntimeBackgroundSupport, "true");
+    transaction.Set(kAppDBRuntimeSection, kAppDBRuntimeBackgroundSupport,
+                    "true");
   } else {
-    appdb->Set(kAppDBRuntimeSection, kAppDBRuntimeBackgroundSupport, "false");
+    transaction.Set(kAppDBRuntimeSection, kAppDBRuntimeBackgroundSupport,
+                    "false");
   }
-  appdb->Remove(kAppDBRuntimeSection, kAppDBRuntimeBundle);
+  transaction.Remove(kAppDBRuntimeSection, kAppDBRuntimeBundle);
+  transaction.Commit();
 
   ResetWebApplication(NativeWindow::Type::NORMAL);
 
@@ -142,6 +145,7 @@ bool UiRuntime::OnCreate() {
 }
 
 void UiRuntime::OnTerminate() {
+  common::AppDB::GetInstance()->Shutdown();
 }
 
 void UiRuntime::Terminate() {
@@ -153,6 +157,7 @@ void UiRuntime::OnPause() {
   if (application_->launched()) {
     application_->Suspend();
   }
+  common::AppDB::GetInstance()->Flush();
 }
 
 void UiRuntime::OnResume() {
@@ -75,15 +75,18 @@ bool WatchRuntime::OnCreate() {
   std::string appid = cmd->GetAppIdFromCommandLine(kRuntimeExecName);
 
   // Init AppDB for Runtime
-  common::AppDB* appdb = common::AppDB::GetInstance();
-  appdb->Set(kAppDBRuntimeSection, kAppDBRuntimeName, "xwalk-tizen");
-  appdb->Set(kAppDBRuntimeSection, kAppDBRuntimeAppID, appid);
+  common::AppDB::Transaction transaction(common::AppDB::GetInstance());
+  transaction.Set(kAppDBRuntimeSection, kAppDBRuntimeName, "xwalk-tizen");
+  transaction.Set(kAppDBRuntimeSection, kAppDBRuntimeAppID, appid);
   if (app_data_->setting_info()->background_support_enabled()) {
-    appdb->Set(kAppDBRuntimeSection, kAppDBRuntimeBackgroundSupport, "true");
+    transaction.Set(kAppDBRuntimeSection, kAppDBRuntimeBackgroundSupport,
+                    "true");
   } else {
-    appdb->Set(kAppDBRuntimeSection, kAppDBRuntimeBackgroundSupport, "false");
+    transaction.Set(kAppDBRuntimeSection, kAppDBRuntimeBackgroundSupport,
+                    "false");
   }
-  appdb->Remove(kAppDBRuntimeSection, kAppDBRuntimeBundle);
+  transaction.Remove(kAppDBRuntimeSection, kAppDBRuntimeBundle);
+  transaction.Commit();
 
   // Init WebApplication
   native_window_ = CreateNativeWindow();
@@ -99,6 +102,7 @@ bool WatchRuntime::OnCreate() {
 }
 
 void WatchRuntime::OnTerminate() {
+  common::AppDB::GetInstance()->Shutdown();
 }
 
 void WatchRuntime::Terminate() {
@@ -109,6 +113,7 @@ void WatchRuntime::OnPause() {
   if (application_->launched()) {
     application_->Suspend();
   }
+  common::AppDB::GetInstance()->Flush();
 }
 
 void WatchRuntime::OnResume() {
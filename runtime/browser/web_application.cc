@@ -960,6 +960,17 @@ void WebApplication::OnConsoleMessage(const std::string& msg, int level) {
 void WebApplication::OnLowMemory() {
   ewk_context_cache_clear(ewk_context_);
   ewk_context_notify_low_memory(ewk_context_);
+
+  // The renderer keeps the decrypted resources of an encrypted app.
+  auto setting = app_data_->setting_info();
+  if (setting.get() != NULL && setting->encryption_enabled()) {
+    Ewk_IPC_Wrt_Message_Data* msg = ewk_ipc_wrt_message_data_new();
+    ewk_ipc_wrt_message_data_type_set(msg, "tizen://lowMemory");
+    if (!ewk_ipc_wrt_message_send(ewk_context_, msg)) {
+      LOGGER(ERROR) << "Failed to send low memory message";
+    }
+    ewk_ipc_wrt_message_data_del(msg);
+  }
 }
 
 void WebApplication::OnSoftKeyboardChangeEvent(WebView* /*view*/,
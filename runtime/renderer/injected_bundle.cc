@@ -21,9 +21,11 @@
 #include <v8.h>
 #include <dlfcn.h>
 
+#include <cstring>
 #include <memory>
 #include <string>
 
+#include "common/app_db.h"
 #include "common/application_data.h"
 #include "common/locale_manager.h"
 #include "common/logger.h"
@@ -31,6 +33,7 @@
 #include "common/resource_manager.h"
 #include "common/string_utils.h"
 #include "extensions/renderer/runtime_ipc_client.h"
+#include "extensions/renderer/sync_message_watchdog.h"
 #include "extensions/renderer/widget_module.h"
 #include "extensions/renderer/xwalk_extension_renderer_controller.h"
 #include "extensions/renderer/xwalk_module_system.h"
@@ -137,6 +140,13 @@ extern "C" void DynamicPluginStopSession(
   extensions::XWalkExtensionRendererController& controller =
       extensions::XWalkExtensionRendererController::GetInstance();
   controller.WillReleaseScriptContext(context);
+  // The page may be the last one of the process.
+  if (extensions::XWalkExtensionRendererController::plugin_session_count <= 0) {
+    common::AppDB::GetInstance()->Shutdown();
+    extensions::SyncMessageWatchdog::GetInstance()->Stop();
+  } else {
+    common::AppDB::GetInstance()->Flush();
+  }
 }
 
 extern "C" void DynamicUrlParsing(
@@ -173,6 +183,17 @@ extern "C" void DynamicDatabaseAttach(int /*attach*/) {
 
 extern "C" void DynamicOnIPCMessage(const Ewk_IPC_Wrt_Message_Data& data) {
   SCOPE_PROFILE();
+  Eina_Stringshare* type = ewk_ipc_wrt_message_data_type_get(&data);
+  bool low_memory = type != NULL && !strcmp(type, "tizen://lowMemory");
+  eina_stringshare_del(type);
+  if (low_memory) {
+    auto res_manager =
+        runtime::BundleGlobalData::GetInstance()->resource_manager();
+    if (res_manager != NULL)
+      res_manager->ClearDecryptedCache();
+    return;
+  }
+
   extensions::XWalkExtensionRendererController& controller =
     extensions::XWalkExtensionRendererController::GetInstance();
   controller.OnReceivedIPCMessage(&data);
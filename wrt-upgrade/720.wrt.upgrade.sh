@@ -7,6 +7,7 @@ PATH=/bin:/usr/bin:/sbin:/usr/sbin
 #remove unuse databases
 rm /opt/dbspace/.wrt.db
 rm /opt/dbspace/.wrt.db-journal
+rm /opt/dbspace/.wrt-upgrade.journal
 
 rm -r /opt/share/widget
 
@@ -161,6 +161,11 @@ void WrtUpgradeInfo::addSecurityOriginInfo(SecurityOriginInfo security_origin) {
 void WrtUpgradeInfo::addCertificateInfo(CertificateInfo certificate) {
   certificate_info_list.push_back(certificate);
 }
+void WrtUpgradeInfo::clearInfo() {
+  std::vector<PreferenceInfo>().swap(preference_info_list_);
+  std::vector<SecurityOriginInfo>().swap(security_origin_info_list_);
+  std::vector<CertificateInfo>().swap(certificate_info_list);
+}
 
 std::string WrtUpgradeInfo::getSecurityOriginDB() {
   return app_dir_ + kAppSecurityOriginDBFile;
@@ -14,9 +14,9 @@ namespace upgrade {
 class PreferenceInfo{
  public:
   PreferenceInfo(std::string key, std::string value);
-  std::string getSection() {return m_section_;}
-  std::string getKey() {return m_key_;}
-  std::string getValue() {return m_value_;}
+  const std::string& getSection() const {return m_section_;}
+  const std::string& getKey() const {return m_key_;}
+  const std::string& getValue() const {return m_value_;}
  private:
   std::string m_section_;
   std::string m_key_;
@@ -31,9 +31,9 @@ class SecurityOriginInfo{
         std::string host,
         int port,
         int result);
-  std::string getSection() {return m_section_;}
-  std::string getKey() {return m_key_;}
-  std::string getValue() {return m_value_;}
+  const std::string& getSection() const {return m_section_;}
+  const std::string& getKey() const {return m_key_;}
+  const std::string& getValue() const {return m_value_;}
  private:
   std::string translateKey(
      int feature,
@@ -51,9 +51,9 @@ class CertificateInfo{
     CertificateInfo(
         std::string pem,
         int result);
-  std::string getSection() {return m_section_;}
-  std::string getKey() {return m_key_;}
-  std::string getValue() {return m_value_;}
+  const std::string& getSection() const {return m_section_;}
+  const std::string& getKey() const {return m_key_;}
+  const std::string& getValue() const {return m_value_;}
  private:
   std::string translateKey(std::string pem);
   std::string translateValue(int result);
@@ -77,20 +77,23 @@ class WrtUpgradeInfo{
   void addSecurityOriginInfo(SecurityOriginInfo security_origin);
   void addCertificateInfo(CertificateInfo certificate);
 
-  PreferenceInfo getPreferenceInfo(int idx)
+  const PreferenceInfo& getPreferenceInfo(int idx) const
       {return preference_info_list_[idx];}
-  SecurityOriginInfo getSecurityOriginInfo(int idx)
+  const SecurityOriginInfo& getSecurityOriginInfo(int idx) const
       {return security_origin_info_list_[idx];}
-  CertificateInfo getCertificateInfo(int idx)
+  const CertificateInfo& getCertificateInfo(int idx) const
       {return certificate_info_list[idx];}
 
-  int getPreferenceInfoSize()
+  int getPreferenceInfoSize() const
       {return static_cast<int>(preference_info_list_.size());}
-  int getSecurityOriginInfoSize()
+  int getSecurityOriginInfoSize() const
       {return static_cast<int>(security_origin_info_list_.size());}
-  int getCertificateInfoSize()
+  int getCertificateInfoSize() const
       {return static_cast<int>(certificate_info_list.size());}
 
+  // Frees the migrated data once it is written.
+  void clearInfo();
+
  private:
   std::string pkg_id_;
   std::string app_id_;
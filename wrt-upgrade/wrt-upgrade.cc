@@ -5,11 +5,19 @@
 
 #include "wrt-upgrade/wrt-upgrade.h"
 
+#include <errno.h>
+#include <fcntl.h>
 #include <sqlite3.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <iostream>
 #include <fstream>
+#include <map>
+#include <set>
+#include <thread>
 #include <utility>
 
 #include "common/picojson.h"
@@ -20,20 +28,131 @@ namespace {
   const std::string kWRTDbFile = "/opt/dbspace/.wrt.db";
   const std::string kAppDirectoryPrefix = "/opt/usr/home/owner/apps_rw/";
   const std::string kAppMigrationFile = "/data/.runtime.migration";
+  const std::string kTempFilePostfix = ".tmp";
   const std::string kJournalPostfix = "-journal";
+  // Lists the applications which are migrated, one id per line, so an
+  // interrupted upgrade does not migrate them again. It is removed with the
+  // wrt database by 720.wrt.upgrade.sh.
+  const std::string kUpgradeJournalFile = "/opt/dbspace/.wrt-upgrade.journal";
+
+// Prints how long a phase of the upgrade took when it goes out of scope.
+class PhaseTimer {
+ public:
+  explicit PhaseTimer(const char* phase)
+      : phase_(phase), start_(std::chrono::steady_clock::now()) {}
+  ~PhaseTimer() {
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start_);
+    std::cout << phase_ << " took " << elapsed.count() << "ms" << std::endl;
+  }
+ private:
+  const char* phase_;
+  std::chrono::steady_clock::time_point start_;
+};
+// Flushes |path| to the disk.
+bool SyncPath(const std::string& path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  bool synced = (fsync(fd) == 0);
+  close(fd);
+  return synced;
+}
+// Flushes the directory of the absolute |path|, so that a file renamed or
+// created there persists.
+bool SyncDirectoryOf(const std::string& path) {
+  return SyncPath(path.substr(0, path.rfind('/')));
+}
+// Writes a migration file one row at a time, without building it in memory.
+// The rows are written to a temporary file which replaces the migration
+// file when it is complete, so the runtime never reads a partial file. Both
+// the file and the rename are on the disk when Commit() returns.
+class MigrationFileWriter {
+ public:
+  explicit MigrationFileWriter(const std::string& path)
+      : path_(path), temp_path_(path + kTempFilePostfix),
+        first_list_(true), first_row_(true) {}
+  ~MigrationFileWriter() {
+    if (file_.is_open()) {
+      file_.close();
+      remove(temp_path_.c_str());
+    }
+  }
+  bool Open() {
+    file_.open(temp_path_, std::ios::out | std::ios::trunc);
+    if (!file_.is_open())
+      return false;
+    file_ << '{';
+    return true;
+  }
+  void BeginList(const char* name) {
+    if (!first_list_)
+      file_ << ',';
+    first_list_ = false;
+    first_row_ = true;
+    picojson::serialize_str(name, std::ostreambuf_iterator<char>(file_));
+    file_ << ":[";
+  }
+  void AddRow(const std::string& section,
+              const std::string& key,
+              const std::string& value) {
+    if (!first_row_)
+      file_ << ',';
+    first_row_ = false;
+    file_ << "{\"section\":";
+    picojson::serialize_str(section, std::ostreambuf_iterator<char>(file_));
+    file_ << ",\"key\":";
+    picojson::serialize_str(key, std::ostreambuf_iterator<char>(file_));
+    file_ << ",\"value\":";
+    picojson::serialize_str(value, std::ostreambuf_iterator<char>(file_));
+    file_ << '}';
+  }
+  void EndList() {
+    file_ << ']';
+  }
+  bool Commit() {
+    file_ << '}';
+    file_.close();
+    if (file_.fail() || !SyncPath(temp_path_) ||
+        rename(temp_path_.c_str(), path_.c_str()) != 0) {
+      remove(temp_path_.c_str());
+      return false;
+    }
+    return SyncDirectoryOf(path_);
+  }
+
+ private:
+  std::string path_;
+  std::string temp_path_;
+  std::ofstream file_;
+  bool first_list_;
+  bool first_row_;
+};
 }  // namespace
 
 namespace upgrade {
-WrtUpgrade::WrtUpgrade() {
+WrtUpgrade::WrtUpgrade()
+    : journal_fd_(-1) {
 }
 WrtUpgrade::~WrtUpgrade() {
+  if (journal_fd_ >= 0)
+    close(journal_fd_);
 }
 void WrtUpgrade::Run() {
-  ParseWrtDatabse();
-  ParseSecurityOriginDatabase();
-  ParseCertificatenDatabase();
-  CreateMigrationFile();
-  RemoveDatabases();
+  PhaseTimer timer("upgrade");
+  {
+    PhaseTimer timer("parseWrtDatabse");
+    ParseWrtDatabse();
+  }
+  LoadJournal();
+  {
+    PhaseTimer timer("migrateApplications");
+    MigrateApplications();
+  }
+  {
+    PhaseTimer timer("removeDatabases");
+    RemoveDatabases();
+  }
 }
 void WrtUpgrade::ParseWrtDatabse() {
   std::cout << "parseWrtDatabse" << std::endl;
@@ -98,116 +217,296 @@ void WrtUpgrade::ParseWrtDatabse() {
   }
   sqlite3_close(wrt_db);
 }
-void WrtUpgrade::ParseSecurityOriginDatabase() {
-  std::cout << "parseSecurityOriginDatabase" << std::endl;
-  for (int i = 0; i < static_cast<int>(application_list_.size()) ; i++) {
-    sqlite3 *security_origin_db;
-    std::string appid = application_list_[i];
-    try {
-      std::string db_path = application_map_[appid].getSecurityOriginDB();
+void WrtUpgrade::LoadJournal() {
+  std::ifstream journal(kUpgradeJournalFile);
+  std::string appid;
+  while (std::getline(journal, appid)) {
+    if (application_map_.find(appid) != application_map_.end())
+      completed_applications_.insert(appid);
+  }
+  if (!completed_applications_.empty()) {
+    std::cout << "resume upgrade, " << completed_applications_.size()
+              << " applications are already migrated" << std::endl;
+  }
+  journal_fd_ = open(kUpgradeJournalFile.c_str(),
+                     O_WRONLY | O_APPEND | O_CREAT, 0644);
+  if (journal_fd_ < 0 ||
+      !SyncDirectoryOf(kUpgradeJournalFile)) {
+    std::cout << "fail to open the upgrade journal" << std::endl;
+  }
+}
+void WrtUpgrade::MigrateApplications() {
+  // The applications of a package share its data directory, so they share
+  // the databases and the migration file, and a package is migrated as a
+  // whole. A package is migrated again if any of its applications is not
+  // journaled yet.
+  std::vector<std::vector<WrtUpgradeInfo*> > packages;
+  std::map<std::string, size_t> package_index;
+  std::set<std::string> pending_packages;
+  for (const auto& appid : application_list_) {
+    WrtUpgradeInfo* info = &application_map_[appid];
+    auto it = package_index.find(info->getPkgid());
+    if (it == package_index.end()) {
+      package_index[info->getPkgid()] = packages.size();
+      packages.push_back(std::vector<WrtUpgradeInfo*>(1, info));
+    } else {
+      packages[it->second].push_back(info);
+    }
+    if (completed_applications_.find(appid) == completed_applications_.end())
+      pending_packages.insert(info->getPkgid());
+  }
+  std::vector<std::vector<WrtUpgradeInfo*>*> pending;
+  for (auto& package : packages) {
+    if (pending_packages.find(package[0]->getPkgid()) !=
+        pending_packages.end())
+      pending.push_back(&package);
+  }
+  if (pending.empty())
+    return;
 
-      if (access(db_path.c_str(), 0) != 0) {
-        throw("file is not exist : ["+db_path+"]");
-      }
-      int ret = sqlite3_open(db_path.c_str(), &security_origin_db);
-      if (ret != SQLITE_OK) {
-        throw("error to open wrt database");
-      }
+  // The packages do not share any state but the journal, so each one is
+  // migrated by the first free thread.
+  size_t thread_count = std::max(1u, std::thread::hardware_concurrency());
+  thread_count = std::min(thread_count, pending.size());
+  std::cout << "migrate " << pending.size() << " packages with "
+            << thread_count << " threads" << std::endl;
 
-      // get applist
-      std::string query = "select * from securityorigininfo";
-      sqlite3_stmt* stmt = NULL;
+  std::atomic<size_t> next(0);
+  auto worker = [&]() {
+    for (size_t i = next++; i < pending.size(); i = next++) {
+      if (MigratePackage(*pending[i]))
+        CompletePackage(*pending[i]);
+    }
+  };
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < thread_count; ++i)
+    threads.push_back(std::thread(worker));
+  worker();
+  for (auto& thread : threads)
+    thread.join();
+}
+// A package whose databases can't be read is neither journaled nor
+// removed, so the next run retries it. The databases are read once, into
+// the first application of the package.
+bool WrtUpgrade::MigratePackage(const std::vector<WrtUpgradeInfo*>& apps) {
+  if (!ParseSecurityOriginDatabase(apps[0]) ||
+      !ParseCertificatenDatabase(apps[0])) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::cout << "fail to migrate " << apps[0]->getPkgid() << std::endl;
+    return false;
+  }
+  return CreateMigrationFile(apps);
+}
+// The entries of a package are on the disk before its databases can be
+// removed, so a crash never loses a migrated package that has no databases
+// left to migrate it again.
+void WrtUpgrade::CompletePackage(const std::vector<WrtUpgradeInfo*>& apps) {
+  std::string entries;
+  for (auto info : apps) {
+    entries += info->getAppid() + "\n";
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto info : apps) {
+    completed_applications_.insert(info->getAppid());
+  }
+  if (journal_fd_ < 0)
+    return;
+  const char* data = entries.data();
+  size_t remaining = entries.size();
+  while (remaining > 0) {
+    ssize_t written = write(journal_fd_, data, remaining);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    data += written;
+    remaining -= written;
+  }
+  if (remaining > 0 || fsync(journal_fd_) != 0) {
+    std::cout << "fail to journal " << apps[0]->getPkgid() << std::endl;
+  }
+}
+// An application without the database has nothing to migrate.
+bool WrtUpgrade::ParseSecurityOriginDatabase(WrtUpgradeInfo* info) {
+  std::string db_path = info->getSecurityOriginDB();
+  if (access(db_path.c_str(), 0) != 0) {
+    return true;
+  }
 
-      ret = sqlite3_prepare_v2(
-              security_origin_db, query.c_str() , -1, &stmt, NULL);
-      if (ret != SQLITE_OK) {
-        throw("error for prepare query");
-      }
+  sqlite3 *security_origin_db = NULL;
+  bool success = true;
+  try {
+    int ret = sqlite3_open(db_path.c_str(), &security_origin_db);
+    if (ret != SQLITE_OK) {
+      throw("error to open wrt database");
+    }
 
-      while (SQLITE_ROW == sqlite3_step(stmt)) {
-        int feature = sqlite3_column_int(stmt, 0);
-        std::string scheme
-          = std::string(reinterpret_cast<const char*>(
-                         sqlite3_column_text(stmt, 1)));
-        std::string host
-          = std::string(reinterpret_cast<const char*>(
-                         sqlite3_column_text(stmt, 2)));
-        int port = sqlite3_column_int(stmt, 3);
-        int result = sqlite3_column_int(stmt, 4);
-        application_map_[appid].addSecurityOriginInfo(
-          SecurityOriginInfo(feature, scheme, host, port, result));
-      }
+    // get applist
+    std::string query = "select * from securityorigininfo";
+    sqlite3_stmt* stmt = NULL;
 
-      ret = sqlite3_finalize(stmt);
-      if (ret != SQLITE_OK) {
-        throw("error for finalize stmt");
-      }
-    } catch(...) {
+    ret = sqlite3_prepare_v2(
+            security_origin_db, query.c_str() , -1, &stmt, NULL);
+    if (ret != SQLITE_OK) {
+      throw("error for prepare query");
     }
-    sqlite3_close(security_origin_db);
+
+    while (SQLITE_ROW == (ret = sqlite3_step(stmt))) {
+      int feature = sqlite3_column_int(stmt, 0);
+      std::string scheme
+        = std::string(reinterpret_cast<const char*>(
+                       sqlite3_column_text(stmt, 1)));
+      std::string host
+        = std::string(reinterpret_cast<const char*>(
+                       sqlite3_column_text(stmt, 2)));
+      int port = sqlite3_column_int(stmt, 3);
+      int result = sqlite3_column_int(stmt, 4);
+      info->addSecurityOriginInfo(
+        SecurityOriginInfo(feature, scheme, host, port, result));
+    }
+    if (ret != SQLITE_DONE) {
+      sqlite3_finalize(stmt);
+      throw("error to read security origin database");
+    }
+
+    ret = sqlite3_finalize(stmt);
+    if (ret != SQLITE_OK) {
+      throw("error for finalize stmt");
+    }
+  } catch(const char* err) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::cout << err << " : [" << db_path << "]" << std::endl;
+    success = false;
   }
+  sqlite3_close(security_origin_db);
+  return success;
 }
-void WrtUpgrade::ParseCertificatenDatabase() {
-  std::cout << "parseCertificateDatabase" << std::endl;
-  for (int i = 0 ; i < static_cast<int>(application_list_.size()) ; i++) {
-    sqlite3 *certificate_db;
-    std::string appid = application_list_[i];
-    try {
-      std::string db_path = application_map_[appid].getCertificateDB();
+bool WrtUpgrade::ParseCertificatenDatabase(WrtUpgradeInfo* info) {
+  std::string db_path = info->getCertificateDB();
+  if (access(db_path.c_str(), 0) != 0) {
+    return true;
+  }
 
-      if (access(db_path.c_str(), 0) != 0) {
-        throw("file is not exist : ["+db_path+"]");
-      }
-      int ret = sqlite3_open(db_path.c_str(), &certificate_db);
-      if (ret != SQLITE_OK) {
-        throw("error to open wrt database");
-      }
+  sqlite3 *certificate_db = NULL;
+  bool success = true;
+  try {
+    int ret = sqlite3_open(db_path.c_str(), &certificate_db);
+    if (ret != SQLITE_OK) {
+      throw("error to open wrt database");
+    }
 
-      // get applist
-      std::string query = "select * from certificateinfo";
-      sqlite3_stmt* stmt = NULL;
+    // get applist
+    std::string query = "select * from certificateinfo";
+    sqlite3_stmt* stmt = NULL;
+
+    ret = sqlite3_prepare_v2(certificate_db, query.c_str() , -1, &stmt, NULL);
+    if (ret != SQLITE_OK) {
+      throw("error for prepare query");
+    }
 
-      ret = sqlite3_prepare_v2(certificate_db, query.c_str() , -1, &stmt, NULL);
-      if (ret != SQLITE_OK) {
-        throw("error for prepare query");
+    while (SQLITE_ROW == (ret = sqlite3_step(stmt))) {
+      std::string certificate
+        = std::string(reinterpret_cast<const char*>(
+                       sqlite3_column_text(stmt, 0)));
+      int result = sqlite3_column_int(stmt, 1);
+      info->addCertificateInfo(CertificateInfo(certificate, result));
+    }
+    if (ret != SQLITE_DONE) {
+      sqlite3_finalize(stmt);
+      throw("error to read certificate database");
+    }
+
+    ret = sqlite3_finalize(stmt);
+    if (ret != SQLITE_OK) {
+      throw("error for finalize stmt");
+    }
+  } catch(const char* err) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::cout << err << " : [" << db_path << "]" << std::endl;
+    success = false;
+  }
+  sqlite3_close(certificate_db);
+  return success;
+}
+bool WrtUpgrade::CreateMigrationFile(
+    const std::vector<WrtUpgradeInfo*>& apps) {
+  int row_count = 0;
+  for (auto info : apps) {
+    row_count += info->getPreferenceInfoSize()
+                 + info->getSecurityOriginInfoSize()
+                 + info->getCertificateInfoSize();
+  }
+  if (row_count == 0) {
+    return true;
+  }
+  const std::string pkgid = apps[0]->getPkgid();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::cout << "createMigrationFile for " << pkgid << std::endl;
+  }
+
+  std::string output_file_path
+    = kAppDirectoryPrefix + pkgid + kAppMigrationFile;
+  MigrationFileWriter writer(output_file_path);
+  bool success = writer.Open();
+  if (success) {
+    writer.BeginList("preference");
+    for (auto info : apps) {
+      for (int i = 0 ; i < info->getPreferenceInfoSize() ; i++) {
+        const PreferenceInfo& p_info = info->getPreferenceInfo(i);
+        writer.AddRow(p_info.getSection(), p_info.getKey(),
+                      p_info.getValue());
       }
+    }
+    writer.EndList();
 
-      while (SQLITE_ROW == sqlite3_step(stmt)) {
-        std::string certificate
-          = std::string(reinterpret_cast<const char*>(
-                         sqlite3_column_text(stmt, 0)));
-        int result = sqlite3_column_int(stmt, 1);
-        application_map_[appid].addCertificateInfo(
-                                  CertificateInfo(certificate, result));
+    writer.BeginList("security_origin");
+    for (auto info : apps) {
+      for (int i = 0 ; i < info->getSecurityOriginInfoSize() ; i++) {
+        const SecurityOriginInfo& s_info = info->getSecurityOriginInfo(i);
+        writer.AddRow(s_info.getSection(), s_info.getKey(),
+                      s_info.getValue());
       }
+    }
+    writer.EndList();
 
-      ret = sqlite3_finalize(stmt);
-      if (ret != SQLITE_OK) {
-        throw("error for finalize stmt");
+    writer.BeginList("certificate");
+    for (auto info : apps) {
+      for (int i = 0 ; i < info->getCertificateInfoSize() ; i++) {
+        const CertificateInfo& c_info = info->getCertificateInfo(i);
+        writer.AddRow(c_info.getSection(), c_info.getKey(),
+                      c_info.getValue());
       }
-    } catch(...) {
     }
-    sqlite3_close(certificate_db);
+    writer.EndList();
+    success = writer.Commit();
   }
-}
-void WrtUpgrade::CreateMigrationFile() {
-  std::cout << "createMigrationFile" << std::endl;
-  for (int i = 0 ; i < static_cast<int>(application_list_.size()) ; i++) {
-    std::string appid = application_list_[i];
-    std::string json_str = CreateJsonObject(appid);
-    if (!json_str.empty()) {
-      std::string pkg_id = appid.substr(0, appid.find_first_of('.'));
-      std::string output_file_path
-        = kAppDirectoryPrefix + pkg_id + kAppMigrationFile;
-      std::ofstream output_file(output_file_path);
-      output_file << json_str;
-      output_file.close();
-    }
+  if (!success) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::cout << "fail to write " << output_file_path << std::endl;
   }
+  for (auto info : apps) {
+    info->clearInfo();
+  }
+  return success;
 }
 void WrtUpgrade::RemoveDatabases() {
+  // The databases of a package which failed to migrate are kept, so the
+  // next run can retry it. The migration files and the journal entries of
+  // the others were synced when they were written.
+  std::set<std::string> kept_packages;
+  for (const auto& appid : application_list_) {
+    if (completed_applications_.find(appid) == completed_applications_.end())
+      kept_packages.insert(application_map_[appid].getPkgid());
+  }
+  std::set<std::string> removed_packages;
   for (int i = 0 ; i < static_cast<int>(application_list_.size()) ; i++) {
     std::string appid = application_list_[i];
+    std::string pkgid = application_map_[appid].getPkgid();
+    if (kept_packages.find(pkgid) != kept_packages.end() ||
+        !removed_packages.insert(pkgid).second)
+      continue;
     try {
       std::string security_origin_db_path
         = application_map_[appid].getSecurityOriginDB();
@@ -226,58 +525,6 @@ void WrtUpgrade::RemoveDatabases() {
     }
   }
 }
-std::string WrtUpgrade::CreateJsonObject(std::string appid) {
-  WrtUpgradeInfo info = application_map_[appid];
-
-  if (info.getPreferenceInfoSize() == 0
-      && info.getSecurityOriginInfoSize() == 0
-      && info.getCertificateInfoSize() == 0) {
-    return "";
-  }
-  std::cout << "createJsonObject for " << appid << std::endl;
-
-  // make preference value arr : vector
-  picojson::array preference_arr;
-  for (int i = 0 ; i < info.getPreferenceInfoSize() ; i++) {
-    PreferenceInfo p_info = info.getPreferenceInfo(i);
-    picojson::object obj;
-    obj["key"] = picojson::value(p_info.getKey());
-    obj["value"] = picojson::value(p_info.getValue());
-    preference_arr.push_back(picojson::value(obj));
-  }
-
-  // make security_origin value arr : vector
-  picojson::array securityorigin_arr;
-  for (int i = 0 ; i < info.getSecurityOriginInfoSize() ; i++) {
-    SecurityOriginInfo s_info = info.getSecurityOriginInfo(i);
-    picojson::object obj;
-    obj["section"] = picojson::value(s_info.getSection());
-    obj["key"] = picojson::value(s_info.getKey());
-    obj["value"] = picojson::value(s_info.getValue());
-    securityorigin_arr.push_back(picojson::value(obj));
-  }
-
-  // make certificate value arr : vector
-  picojson::array certificate_arr;
-  for (int i = 0 ; i < info.getCertificateInfoSize() ; i++) {
-    CertificateInfo c_info = info.getCertificateInfo(i);
-    picojson::object obj;
-    obj["section"] = picojson::value(c_info.getSection());
-    obj["key"] = picojson::value(c_info.getKey());
-    obj["value"] = picojson::value(c_info.getValue());
-    certificate_arr.push_back(picojson::value(obj));
-  }
-
-  // make one json
-  picojson::object migration_obj;
-  migration_obj["preference"] = picojson::value(preference_arr);
-  migration_obj["security_orgin"] = picojson::value(securityorigin_arr);
-  migration_obj["certificate"] = picojson::value(certificate_arr);
-
-  picojson::value migration_val = picojson::value(migration_obj);
-  std::string json_str = migration_val.serialize();
-  return json_str;
-}
 bool WrtUpgrade::RemoveFile(const std::string& path) {
   if (!common::utils::Exists(path)) {
     LOGGER(ERROR) << "File is not Exist : " << path;
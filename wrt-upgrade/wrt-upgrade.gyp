@@ -21,6 +21,7 @@
       },
       'libraries' : [
         '-ldl',
+        '-lpthread',
       ],
       'copies': [
         {
@@ -8,6 +8,8 @@
 #include <iostream>
 #include <vector>
 #include <map>
+#include <mutex>
+#include <set>
 #include <string>
 
 #include "wrt-upgrade/wrt-upgrade-info.h"
@@ -18,17 +20,27 @@ class WrtUpgrade{
   WrtUpgrade();
   ~WrtUpgrade();
   void Run();
+
  private:
   void ParseWrtDatabse();
-  void ParseSecurityOriginDatabase();
-  void ParseCertificatenDatabase();
-  void CreateMigrationFile();
+  void LoadJournal();
+  void MigrateApplications();
+  bool MigratePackage(const std::vector<WrtUpgradeInfo*>& apps);
+  bool ParseSecurityOriginDatabase(WrtUpgradeInfo* info);
+  bool ParseCertificatenDatabase(WrtUpgradeInfo* info);
+  bool CreateMigrationFile(const std::vector<WrtUpgradeInfo*>& apps);
+  void CompletePackage(const std::vector<WrtUpgradeInfo*>& apps);
   void RemoveDatabases();
   bool RemoveFile(const std::string& path);
   void RedirectSymlink();
-  std::string CreateJsonObject(std::string appid);
   std::vector<std::string> application_list_;
   std::map<std::string, WrtUpgradeInfo> application_map_;
+  // The applications migrated by this or an interrupted earlier run.
+  std::set<std::string> completed_applications_;
+  // Guards |completed_applications_|, |journal_fd_| and the output of the
+  // migration threads.
+  std::mutex mutex_;
+  int journal_fd_;
 };
 }  // namespace upgrade
 #endif  // WRT_UPGRADE_H